@@ -5,39 +5,176 @@
  *
  * Overview:
  * This program creates a key for use in a one-time pad.
+ * Keys come from the ChaCha20 generator in otp_random.c,
+ * with every thread running its own generator over its own
+ * blocks, so pads of many gigabytes can be made at disk
+ * speed.
  ************************************************************/
 
+#define _GNU_SOURCE    //fallocate
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "otp_cipher.h"
+#include "otp_stream.h"
+#include "otp_random.h"
+
+#define KEYGEN_BLOCK (1 << 20)    //bytes each thread generates and writes at a time
+
+struct keygenJob {
+    long long length;        //key bytes to generate, not counting the newline
+    long long nextBlock;     //next block to hand out, taken atomically
+    int outfd;
+    int sequential;          //output can't seek, blocks are written in whatever order they finish
+    int binary;              //all 256 byte values instead of the text alphabet
+    pthread_mutex_t lock;    //serializes sequential writes
+    int failed;
+};
+
+/***********************************************************
+ * keygenWorker: thread body. takes blocks until the key is
+ *               complete and writes each one as it's done.
+ *
+ * parameters: shared job.
+ * returns: NULL.
+ ***********************************************************/
+
+static void *keygenWorker(void *arg) {
+    struct keygenJob *job = arg;
+    struct randomState rng;
+    long long block, offset;
+    size_t length;
+    char *buffer = malloc(KEYGEN_BLOCK);
+
+    if (buffer == NULL || randomSeed(&rng) < 0) {
+        job->failed = errno;
+        free(buffer);
+        return NULL;
+    }
+    while (!job->failed) {
+        block = __atomic_fetch_add(&job->nextBlock, 1, __ATOMIC_RELAXED);
+        offset = block * KEYGEN_BLOCK;
+        if (offset >= job->length)
+            break;
+        length = job->length - offset < KEYGEN_BLOCK ? job->length - offset : KEYGEN_BLOCK;
+        randomKey(&rng, buffer, length, job->binary ? &byteAlphabet : &textAlphabet);
+
+        if (job->sequential) {    //pipes and terminals: one block at a time
+            pthread_mutex_lock(&job->lock);
+            if (writeFull(job->outfd, buffer, length) < 0)
+                job->failed = errno;
+            pthread_mutex_unlock(&job->lock);
+        } else {    //files: every block goes straight to its own place
+            size_t done = 0;
+            ssize_t n;
+            while (done < length) {
+                n = pwrite(job->outfd, buffer + done, length - done, offset + done);
+                if (n < 0 && errno != EINTR) {
+                    job->failed = errno;
+                    break;
+                }
+                if (n > 0)
+                    done += n;
+            }
+        }
+    }
+    free(buffer);
+    return NULL;
+}
 
 
 /***********************************************************
  * main: creates key based on number of chars.
  *
  * parameters: number of arguments, argument array.
- * returns: none.
+ * returns: exit status.
  ***********************************************************/
 
 int main (int argc, char *argv[]){
+    struct keygenJob job;
+    struct timespec start, end;
+    pthread_t *threads;
+    const char *outFile = NULL;
+    char *endptr;
+    double seconds;
+    int i, opt, threadCount = sysconf(_SC_NPROCESSORS_ONLN);
 
-    int i, length;
-    char key[length + 1];
-    char randomLetter;
+    memset(&job, '\0', sizeof(job));
+    while ((opt = getopt(argc, argv, "t:o:b")) != -1) {
+        if (opt == 't' && atoi(optarg) > 0) {
+            threadCount = atoi(optarg);    //generator threads, one per CPU by default
+        } else if (opt == 'o') {
+            outFile = optarg;    //preallocated file instead of stdout
+        } else if (opt == 'b') {
+            job.binary = 1;    //binary pad for -b clients, no newline
+        } else {
+            optind = argc;    //force the usage message
+            break;
+        }
+    }
+    if (argc - optind != 1){
+        fprintf(stderr, "Usage: %s [-t threads] [-o file] [-b] length\n", argv[0]);    //check usage & args
+        exit(1);
+    }
+    job.length = strtoll(argv[optind], &endptr, 10);
+    if (*endptr != '\0' || job.length < 0) {
+        fprintf(stderr, "keygen: ERROR invalid length %s\n", argv[optind]);
+        exit(1);
+    }
 
-    if (argc != 2){
-        printf("Usage: %s length\n", argv[0]);    //check usage & args
-        exit (0);
+    job.outfd = STDOUT_FILENO;
+    if (outFile != NULL) {
+        job.outfd = open(outFile, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (job.outfd < 0) {
+            fprintf(stderr, "keygen: ERROR opening %s: %s\n", outFile, strerror(errno));
+            exit(1);
+        }
+        if (job.length + !job.binary > 0 && fallocate(job.outfd, 0, 0, job.length + !job.binary) < 0 &&
+            errno != EOPNOTSUPP) {    //reserve the space up front, so a full disk fails now
+            fprintf(stderr, "keygen: ERROR allocating %s: %s\n", outFile, strerror(errno));
+            exit(1);
+        }
+    } else {
+        job.sequential = 1;    //stdout may be a pipe, or a file opened for append
     }
-    srand(time(NULL));    //randomize with time
-    length = atoi(argv[1]);    //cast length from char to int
+    pthread_mutex_init(&job.lock, NULL);
 
-    for (i=0; i<length; i++){    //for each char
-        randomLetter = " ABCDEFGHIJKLMNOPQRSTUVWXYZ"[rand() % 27];    //get random letter
-        key[i] = randomLetter;    //store in key
+    threads = calloc(threadCount, sizeof(*threads));
+    if (threads == NULL) {
+        fprintf(stderr, "keygen: ERROR allocating threads\n");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, keygenWorker, &job) != 0) {
+            threadCount = i;    //carry on with the ones we have
+            break;
+        }
+    }
+    if (threadCount == 0)
+        keygenWorker(&job);
+    for (i = 0; i < threadCount; i++)
+        pthread_join(threads[i], NULL);
+
+    if (!job.failed && !job.binary) {    //end with newline
+        if (job.sequential ? writeFull(job.outfd, "\n", 1) < 0 : pwrite(job.outfd, "\n", 1, job.length) != 1)
+            job.failed = errno;
+    }
+    if (job.failed) {
+        fprintf(stderr, "keygen: ERROR writing key: %s\n", strerror(job.failed));
+        exit(1);
     }
-    key[length] = '\0';    //end with null terminator
-    printf("%s\n", key);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "keygen: %lld bytes in %.3f s with %d threads (%.1f MB/s)\n", job.length, seconds,
+            threadCount > 0 ? threadCount : 1, seconds > 0 ? job.length / seconds / 1e6 : 0.0);
     return 0;
-}
\ No newline at end of file
+}
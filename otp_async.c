@@ -0,0 +1,755 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_async.c
+ *
+ * Overview:
+ * Non-blocking client library. A request is queued on the
+ * pool for its operation and alphabet, handed to the pooled
+ * connection with the fewest requests in flight, and sent
+ * as "_batch" segments straight from the caller's buffers.
+ * Results come back in order on each connection, so a
+ * connection keeps its requests on a list and fills the
+ * oldest one's output as bytes arrive.
+ *
+ * New connections go to the daemon otp_balance picks. When
+ * a connection fails, its daemon backs off and its requests
+ * go back on the queue, resuming from the first result byte
+ * not yet received: every result byte depends only on the
+ * message and key bytes at the same offset.
+ ************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "otp_cipher.h"
+#include "otp_stream.h"
+#include "otp_server.h"
+#include "otp_async.h"
+#include "otp_balance.h"
+
+#define ASYNC_WINDOW 64       //requests a connection sends ahead of its results
+#define ASYNC_POOL_MAX 64     //largest pool per operation and alphabet
+#define ASYNC_EVENTS 64       //epoll events taken per wait
+
+#define ASYNC_HANDSHAKE 0     //sending the handshake
+#define ASYNC_CONFIRM 1       //waiting for the daemon's confirmation
+#define ASYNC_READY 2         //sending requests and reading results
+#define ASYNC_DEAD 3          //closed, freed at the end of the run
+
+
+struct asyncOp {
+    const char *message;
+    const char *key;
+    char *out;                  //may be message, results land after the bytes they replace were sent
+    size_t length;
+    size_t sent;                //message bytes sent
+    size_t received;            //result bytes read
+    int sendDone;               //terminating zero length sent
+    int attempts;               //connections it has been sent on
+    int error;
+    otpAsyncCallback callback;
+    void *arg;
+    struct asyncOp *next;
+};
+
+struct asyncPool;
+
+struct asyncConn {
+    int fd;
+    int state;
+    uint32_t events;            //epoll interest currently registered
+    struct asyncPool *pool;
+    int endpoint;               //daemon in the client's balancer
+    struct asyncOp *head;       //requests on this connection, oldest first
+    struct asyncOp *tail;
+    struct asyncOp *sendOp;     //first request not fully sent
+    int inFlight;
+    int parked;                 //went idle and hasn't answered since, the daemon may have closed it
+
+    char handshake[32];
+    size_t handshakeLength;
+    size_t handshakeSent;
+    char response[32];
+    size_t responseLength;
+    size_t responseRead;
+
+    uint32_t header;            //length of the segment being sent, big-endian
+    size_t segment;
+    size_t frameSent;           //bytes of header, message and key sent
+    int framing;                //1 while a segment is partly sent
+
+    struct asyncConn *nextDead;
+};
+
+struct asyncPool {
+    struct otpAsync *client;
+    const struct serviceConfig *service;
+    int binary;
+    struct asyncConn *conns[ASYNC_POOL_MAX];
+    int count;
+    struct asyncOp *waitHead;   //requests no connection has room for yet
+    struct asyncOp *waitTail;
+};
+
+struct otpAsync {
+    int epollFD;
+    struct balancer *balancer;
+    int poolSize;
+    struct asyncPool pools[2][2];    //[decrypting][binary]
+    struct asyncOp *doneHead;        //finished, callbacks pending
+    struct asyncOp *doneTail;
+    struct asyncConn *dead;
+    long pending;
+};
+
+
+static void assign(struct asyncPool *pool);
+
+
+/***********************************************************
+ * watch: changes the epoll interest of a connection when
+ *        it differs from what's registered.
+ *
+ * parameters: connection, events wanted.
+ * returns: none.
+ ***********************************************************/
+
+static void watch(struct asyncConn *conn, uint32_t events) {
+    struct epoll_event event;
+
+    if (conn->events == events) {
+        return;
+    }
+    event.events = events;
+    event.data.ptr = conn;
+    epoll_ctl(conn->pool->client->epollFD, EPOLL_CTL_MOD, conn->fd, &event);
+    conn->events = events;
+}
+
+
+/***********************************************************
+ * finishOp: puts a request on the done list for its
+ *           callback.
+ *
+ * parameters: client, request, 0 or an errno.
+ * returns: none.
+ ***********************************************************/
+
+static void finishOp(struct otpAsync *client, struct asyncOp *op, int error) {
+    op->error = error;
+    op->next = NULL;
+    if (client->doneTail != NULL) {
+        client->doneTail->next = op;
+    } else {
+        client->doneHead = op;
+    }
+    client->doneTail = op;
+}
+
+
+/***********************************************************
+ * failConnection: closes a connection, backs its daemon off
+ *                 unless it was only closed for being idle,
+ *                 and puts its requests back at the front
+ *                 of the queue, failing the ones that have
+ *                 been tried on every daemon. the connection
+ *                 is freed at the end of the run, since
+ *                 events for it may still be in the current
+ *                 batch.
+ *
+ * parameters: connection, errno to report.
+ * returns: none.
+ ***********************************************************/
+
+static void failConnection(struct asyncConn *conn, int error) {
+    struct asyncPool *pool = conn->pool;
+    struct otpAsync *client = pool->client;
+    struct asyncOp *op, *next, *retryHead = NULL, *retryTail = NULL;
+    int i;
+    int stale = conn->state == ASYNC_READY && conn->parked;    //closed for idling, not a failing daemon
+
+    if (!stale) {
+        balanceFailed(client->balancer, conn->endpoint);
+    }
+    conn->state = ASYNC_DEAD;
+    close(conn->fd);    //also drops it from the epoll set
+    client->balancer->endpoints[conn->endpoint].outstanding -= conn->inFlight;
+    for (i = 0; i < pool->count; i++) {
+        if (pool->conns[i] == conn) {
+            pool->conns[i] = pool->conns[--pool->count];
+            break;
+        }
+    }
+    for (op = conn->head; op != NULL; op = next) {
+        next = op->next;
+        if (stale) {    //its try never reached a daemon that was still listening
+            op->attempts--;
+        }
+        if (op->sendDone && op->received == op->length) {    //already complete
+            finishOp(client, op, 0);
+        } else if (op->attempts >= client->balancer->count + 1) {
+            finishOp(client, op, error);
+        } else {
+            op->sent = op->received;    //resume where the results stop
+            op->sendDone = 0;
+            op->next = NULL;
+            if (retryTail != NULL) {
+                retryTail->next = op;
+            } else {
+                retryHead = op;
+            }
+            retryTail = op;
+        }
+    }
+    if (retryHead != NULL) {    //ahead of newer requests
+        retryTail->next = pool->waitHead;
+        pool->waitHead = retryHead;
+        if (pool->waitTail == NULL) {
+            pool->waitTail = retryTail;
+        }
+    }
+    conn->head = conn->tail = conn->sendOp = NULL;
+    conn->inFlight = 0;
+    conn->nextDead = client->dead;
+    client->dead = conn;
+
+    if (pool->waitHead != NULL) {    //hand waiting requests to a fresh connection
+        assign(pool);
+    }
+}
+
+
+/***********************************************************
+ * startConnection: opens a non-blocking connection to the
+ *                  daemon the balancer picks, trying others
+ *                  when one refuses at once, and queues its
+ *                  handshake.
+ *
+ * parameters: pool.
+ * returns: connection, or NULL with errno set.
+ ***********************************************************/
+
+static struct asyncConn *startConnection(struct asyncPool *pool) {
+    struct otpAsync *client = pool->client;
+    const struct balanceEndpoint *endpoint;
+    struct asyncConn *conn;
+    struct epoll_event event;
+    int fd = -1, on = 1, picked = 0, attempt, saved;
+
+    for (attempt = 0; fd < 0 && attempt < client->balancer->count; attempt++) {
+        picked = balancePick(client->balancer);
+        endpoint = &client->balancer->endpoints[picked];
+        fd = socket(endpoint->address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+        if (connect(fd, (const struct sockaddr *) &endpoint->address, endpoint->addressLength) < 0 && errno != EINPROGRESS) {
+            saved = errno;    //a Unix socket with nobody on it fails right here
+            close(fd);
+            fd = -1;
+            errno = saved;
+            balanceFailed(client->balancer, picked);
+        }
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    if (endpoint->address.ss_family != AF_UNIX) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));    //segments are already full-sized
+    }
+
+    conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    conn->fd = fd;
+    conn->pool = pool;
+    conn->endpoint = picked;
+    conn->state = ASYNC_HANDSHAKE;
+    conn->handshakeLength = snprintf(conn->handshake, sizeof(conn->handshake), "%s%s",
+                                     pool->service->handshake, pool->binary ? "_batch_bytes" : "_batch") + 1;
+    conn->responseLength = strlen(pool->service->response) + 1;    //NUL included
+
+    event.events = EPOLLOUT;    //writable once the connect finishes
+    event.data.ptr = conn;
+    if (epoll_ctl(client->epollFD, EPOLL_CTL_ADD, fd, &event) < 0) {
+        int saved = errno;
+        close(fd);
+        free(conn);
+        errno = saved;
+        return NULL;
+    }
+    conn->events = EPOLLOUT;
+    pool->conns[pool->count++] = conn;
+    return conn;
+}
+
+
+/***********************************************************
+ * pumpSend: writes queued requests until the socket is
+ *           full or nothing is left to send.
+ *
+ * parameters: ready connection.
+ * returns: none.
+ ***********************************************************/
+
+static void pumpSend(struct asyncConn *conn) {
+    struct msghdr msg = {0};
+    struct iovec iov[3];
+    struct asyncOp *op;
+    ssize_t n;
+    int count;
+
+    while ((op = conn->sendOp) != NULL) {
+        if (!conn->framing) {    //start the next segment, or the zero length that ends the request
+            conn->segment = op->length - op->sent;
+            if (conn->segment > STREAM_SEGMENT) {
+                conn->segment = STREAM_SEGMENT;
+            }
+            conn->header = htonl(conn->segment);
+            conn->frameSent = 0;
+            conn->framing = 1;
+        }
+        if (conn->segment == 0) {
+            iov[0].iov_base = (char *) &conn->header + conn->frameSent;
+            iov[0].iov_len = sizeof(conn->header) - conn->frameSent;
+            count = 1;
+        } else {
+            count = segmentVector(iov, &conn->header, op->message + op->sent, op->key + op->sent,
+                                  conn->segment, conn->frameSent);
+        }
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);    //a daemon that hung up is an error, not a signal in the caller's process
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                watch(conn, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            failConnection(conn, errno);
+            return;
+        }
+        conn->frameSent += n;
+        if (conn->frameSent < sizeof(conn->header) + 2 * conn->segment) {
+            continue;
+        }
+        conn->framing = 0;
+        if (conn->segment > 0) {
+            op->sent += conn->segment;
+        } else {
+            op->sendDone = 1;
+            conn->sendOp = op->next;
+        }
+    }
+    watch(conn, EPOLLIN);
+}
+
+
+/***********************************************************
+ * pumpReceive: reads results into the oldest requests and
+ *              finishes the ones that are complete.
+ *
+ * parameters: ready connection.
+ * returns: none.
+ ***********************************************************/
+
+static void pumpReceive(struct asyncConn *conn) {
+    struct asyncPool *pool = conn->pool;
+    struct asyncOp *op;
+    char scratch[1];
+    int finished = 0;
+    ssize_t n;
+
+    for (;;) {
+        op = conn->head;
+        if (op != NULL && op->received == op->length && op->sendDone) {
+            conn->head = op->next;
+            if (conn->tail == op) {
+                conn->tail = NULL;
+            }
+            conn->inFlight--;
+            conn->parked = conn->inFlight == 0;
+            pool->client->balancer->endpoints[conn->endpoint].outstanding--;
+            finishOp(pool->client, op, 0);
+            finished = 1;
+            continue;
+        }
+
+        if (op == NULL || op->received == op->length) {    //nothing is owed, so only EOF or junk can arrive
+            n = read(conn->fd, scratch, sizeof(scratch));
+            if (n > 0) {
+                failConnection(conn, EPROTO);
+                return;
+            }
+        } else {
+            n = read(conn->fd, op->out + op->received, op->length - op->received);
+        }
+        if (n == 0) {
+            failConnection(conn, ECONNRESET);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            failConnection(conn, errno);
+            return;
+        }
+        op->received += n;
+        conn->parked = 0;
+    }
+
+    if (finished && pool->waitHead != NULL) {
+        assign(pool);
+    }
+}
+
+
+/***********************************************************
+ * handleEvent: moves one connection along after epoll
+ *              reports it.
+ *
+ * parameters: connection, epoll events.
+ * returns: none.
+ ***********************************************************/
+
+static void handleEvent(struct asyncConn *conn, uint32_t events) {
+    ssize_t n;
+
+    if (conn->state == ASYNC_HANDSHAKE) {
+        n = send(conn->fd, conn->handshake + conn->handshakeSent, conn->handshakeLength - conn->handshakeSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                failConnection(conn, errno);
+            }
+            return;
+        }
+        conn->handshakeSent += n;
+        if (conn->handshakeSent < conn->handshakeLength) {
+            return;
+        }
+        conn->state = ASYNC_CONFIRM;    //nothing else goes out until the daemon answers
+        watch(conn, EPOLLIN);
+        return;
+    }
+
+    if (conn->state == ASYNC_CONFIRM) {
+        n = read(conn->fd, conn->response + conn->responseRead, conn->responseLength - conn->responseRead);
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                return;
+            }
+            failConnection(conn, n == 0 ? ECONNRESET : errno);
+            return;
+        }
+        conn->responseRead += n;
+        if (conn->responseRead < conn->responseLength) {
+            return;
+        }
+        if (memcmp(conn->response, conn->pool->service->response, conn->responseLength) != 0) {
+            failConnection(conn, EPROTO);    //reached the wrong daemon
+            return;
+        }
+        conn->state = ASYNC_READY;
+        conn->parked = conn->inFlight == 0;
+        balanceHealthy(conn->pool->client->balancer, conn->endpoint);
+        pumpSend(conn);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        pumpSend(conn);
+    }
+    if (conn->state == ASYNC_READY && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        pumpReceive(conn);
+    }
+}
+
+
+/***********************************************************
+ * assign: hands waiting requests to connections with room,
+ *         opening connections up to the pool size.
+ *
+ * parameters: pool.
+ * returns: none.
+ ***********************************************************/
+
+static void assign(struct asyncPool *pool) {
+    struct otpAsync *client = pool->client;
+    struct asyncConn *best, *conn;
+    struct asyncOp *op;
+    int i;
+
+    while (pool->waitHead != NULL) {
+        best = NULL;
+        for (i = 0; i < pool->count; i++) {
+            if (best == NULL || pool->conns[i]->inFlight < best->inFlight) {
+                best = pool->conns[i];
+            }
+        }
+        if ((best == NULL || best->inFlight > 0) && pool->count < client->poolSize) {    //spread over the pool before queueing
+            conn = startConnection(pool);
+            if (conn != NULL) {
+                best = conn;
+            } else if (best == NULL) {    //no way to reach the daemon
+                int error = errno;
+                while ((op = pool->waitHead) != NULL) {
+                    pool->waitHead = op->next;
+                    finishOp(client, op, error);
+                }
+                pool->waitTail = NULL;
+                return;
+            }
+        }
+        if (best->inFlight >= ASYNC_WINDOW) {    //every connection is full, wait for results
+            return;
+        }
+
+        op = pool->waitHead;
+        pool->waitHead = op->next;
+        if (pool->waitHead == NULL) {
+            pool->waitTail = NULL;
+        }
+        op->next = NULL;
+        if (best->tail != NULL) {
+            best->tail->next = op;
+        } else {
+            best->head = op;
+        }
+        best->tail = op;
+        best->inFlight++;
+        op->attempts++;
+        client->balancer->endpoints[best->endpoint].outstanding++;
+        if (best->sendOp == NULL) {
+            best->sendOp = op;
+            if (best->state == ASYNC_READY) {
+                pumpSend(best);
+            }
+        }
+    }
+}
+
+
+/***********************************************************
+ * otpAsyncOpen: creates a client for one daemon or several.
+ *
+ * parameters: endpoint list (ports, host:port pairs or
+ *             socket paths, comma-separated), connections
+ *             per operation and alphabet.
+ * returns: client, or NULL with errno set.
+ ***********************************************************/
+
+struct otpAsync *otpAsyncOpen(const char *endpoint, int poolSize) {
+    struct otpAsync *client;
+    int decrypting, binary;
+
+    if (poolSize < 1 || poolSize > ASYNC_POOL_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->balancer = balanceOpen(endpoint);
+    if (client->balancer == NULL) {
+        free(client);
+        return NULL;
+    }
+    client->epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (client->epollFD < 0) {
+        balanceClose(client->balancer);
+        free(client);
+        return NULL;
+    }
+    client->poolSize = poolSize;
+    for (decrypting = 0; decrypting < 2; decrypting++) {
+        for (binary = 0; binary < 2; binary++) {
+            client->pools[decrypting][binary].client = client;
+            client->pools[decrypting][binary].service = &cipherServices[decrypting];
+            client->pools[decrypting][binary].binary = binary;
+        }
+    }
+    return client;
+}
+
+
+/***********************************************************
+ * otpAsyncSubmit: queues one request. message and key must
+ *                 stay valid until the callback; out gets
+ *                 length result bytes and may be message.
+ *
+ * parameters: client, V2_ENCRYPT or V2_DECRYPT, 1 for any
+ *             bytes (XOR), message, key, output, length,
+ *             callback and its argument.
+ * returns: 0, or -1 with errno EINVAL on a bad operation
+ *          or text outside the alphabet.
+ ***********************************************************/
+
+int otpAsyncSubmit(struct otpAsync *client, int operation, int binary, const char *message, const char *key,
+                   char *out, size_t length, otpAsyncCallback callback, void *arg) {
+    struct asyncPool *pool;
+    struct asyncOp *op;
+
+    if ((operation != V2_ENCRYPT && operation != V2_DECRYPT) ||
+        (!binary && (!cipherValid(&textAlphabet, message, length) || !cipherValid(&textAlphabet, key, length)))) {
+        errno = EINVAL;
+        return -1;
+    }
+    op = calloc(1, sizeof(*op));
+    if (op == NULL) {
+        return -1;
+    }
+    op->message = message;
+    op->key = key;
+    op->out = out;
+    op->length = length;
+    op->callback = callback;
+    op->arg = arg;
+
+    pool = &client->pools[operation == V2_DECRYPT][binary != 0];
+    if (pool->waitTail != NULL) {
+        pool->waitTail->next = op;
+    } else {
+        pool->waitHead = op;
+    }
+    pool->waitTail = op;
+    client->pending++;
+    assign(pool);
+    return 0;
+}
+
+
+/***********************************************************
+ * otpAsyncRun: waits for the daemon, moves every connection
+ *              along and makes the callbacks that are due.
+ *
+ * parameters: client, timeout in ms (-1 to block).
+ * returns: callbacks made, or -1 with errno set.
+ ***********************************************************/
+
+int otpAsyncRun(struct otpAsync *client, int timeout) {
+    struct epoll_event events[ASYNC_EVENTS];
+    struct asyncConn *conn;
+    struct asyncOp *op;
+    int count, i, made = 0;
+
+    if (client->doneHead != NULL) {    //failures from submit are already due
+        timeout = 0;
+    }
+    count = epoll_wait(client->epollFD, events, ASYNC_EVENTS, timeout);
+    if (count < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        count = 0;
+    }
+    for (i = 0; i < count; i++) {
+        conn = events[i].data.ptr;
+        if (conn->state != ASYNC_DEAD) {
+            handleEvent(conn, events[i].events);
+        }
+    }
+
+    while ((conn = client->dead) != NULL) {
+        client->dead = conn->nextDead;
+        free(conn);
+    }
+
+    while ((op = client->doneHead) != NULL) {    //callbacks may submit, which only appends
+        client->doneHead = op->next;
+        if (client->doneHead == NULL) {
+            client->doneTail = NULL;
+        }
+        client->pending--;
+        op->callback(op->arg, op->error, op->out, op->length);
+        free(op);
+        made++;
+    }
+    return made;
+}
+
+
+/***********************************************************
+ * otpAsyncPending: counts requests whose callback hasn't
+ *                  been made.
+ *
+ * parameters: client.
+ * returns: number of requests.
+ ***********************************************************/
+
+long otpAsyncPending(const struct otpAsync *client) {
+    return client->pending;
+}
+
+
+/***********************************************************
+ * otpAsyncFd: gives the fd to watch from another event
+ *             loop. it's readable when otpAsyncRun has work.
+ *
+ * parameters: client.
+ * returns: epoll fd.
+ ***********************************************************/
+
+int otpAsyncFd(const struct otpAsync *client) {
+    return client->epollFD;
+}
+
+
+/***********************************************************
+ * otpAsyncClose: closes every connection and frees the
+ *                client. outstanding requests are dropped
+ *                without their callbacks.
+ *
+ * parameters: client.
+ * returns: none.
+ ***********************************************************/
+
+void otpAsyncClose(struct otpAsync *client) {
+    struct asyncPool *pool;
+    struct asyncConn *conn;
+    struct asyncOp *op, *next;
+    int decrypting, binary, i;
+
+    for (decrypting = 0; decrypting < 2; decrypting++) {
+        for (binary = 0; binary < 2; binary++) {
+            pool = &client->pools[decrypting][binary];
+            for (i = 0; i < pool->count; i++) {
+                conn = pool->conns[i];
+                close(conn->fd);
+                for (op = conn->head; op != NULL; op = next) {
+                    next = op->next;
+                    free(op);
+                }
+                free(conn);
+            }
+            for (op = pool->waitHead; op != NULL; op = next) {
+                next = op->next;
+                free(op);
+            }
+        }
+    }
+    while ((conn = client->dead) != NULL) {
+        client->dead = conn->nextDead;
+        free(conn);
+    }
+    for (op = client->doneHead; op != NULL; op = next) {
+        next = op->next;
+        free(op);
+    }
+    close(client->epollFD);
+    balanceClose(client->balancer);
+    free(client);
+}
@@ -0,0 +1,42 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_async.h
+ *
+ * Overview:
+ * Non-blocking client library for programs that want the
+ * daemons without running otp_enc / otp_dec. Requests are
+ * plain memory buffers and finish through a callback. Each
+ * operation and alphabet has its own pool of persistent
+ * "_batch" connections, and each pooled connection keeps a
+ * window of requests in flight, so one thread can have
+ * thousands of them outstanding. The endpoint may be a
+ * list of daemons (see otp_balance.h); connections are
+ * spread over them and a request on a connection that
+ * fails is resent on another.
+ *
+ * Everything runs from otpAsyncRun, which waits on one
+ * epoll fd. Programs with their own event loop can watch
+ * otpAsyncFd and call otpAsyncRun(client, 0) when it's
+ * readable. Callbacks are only ever made from otpAsyncRun,
+ * never from otpAsyncSubmit, and may submit more requests.
+ ************************************************************/
+
+#ifndef OTP_ASYNC_H
+#define OTP_ASYNC_H
+
+#include <stddef.h>
+
+struct otpAsync;
+
+typedef void (*otpAsyncCallback)(void *arg, int error, char *out, size_t length);    //error is 0 or an errno
+
+struct otpAsync *otpAsyncOpen(const char *endpoints, int poolSize);
+int otpAsyncSubmit(struct otpAsync *client, int operation, int binary, const char *message, const char *key,
+                   char *out, size_t length, otpAsyncCallback callback, void *arg);
+int otpAsyncRun(struct otpAsync *client, int timeout);
+long otpAsyncPending(const struct otpAsync *client);
+int otpAsyncFd(const struct otpAsync *client);
+void otpAsyncClose(struct otpAsync *client);
+
+#endif
@@ -0,0 +1,187 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_balance.c
+ *
+ * Overview:
+ * Endpoint lists and the pick, fail and recover rules the
+ * clients share. Power of two choices needs no global view
+ * and avoids the herding a strict least-outstanding pick
+ * causes when many requests start at once, while still
+ * steering clear of a daemon that falls behind.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "otp_stream.h"
+#include "otp_balance.h"
+
+
+/***********************************************************
+ * balanceNow: monotonic timestamp for the backoffs.
+ *
+ * parameters: none.
+ * returns: nanoseconds.
+ ***********************************************************/
+
+static uint64_t balanceNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/***********************************************************
+ * balanceRandom: xorshift, good enough to break ties.
+ *
+ * parameters: balancer.
+ * returns: pseudo-random number.
+ ***********************************************************/
+
+static uint32_t balanceRandom(struct balancer *balancer) {
+    uint32_t x = balancer->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    balancer->seed = x;
+    return x;
+}
+
+
+/***********************************************************
+ * balanceOpen: parses an endpoint list and resolves every
+ *              entry up front.
+ *
+ * parameters: comma-separated endpoints.
+ * returns: balancer, or NULL with errno set on an empty
+ *          list, too many entries or one that won't
+ *          resolve.
+ ***********************************************************/
+
+struct balancer *balanceOpen(const char *list) {
+    struct balancer *balancer = calloc(1, sizeof(*balancer));
+    struct balanceEndpoint *endpoint;
+    char *name, *rest;
+
+    if (balancer == NULL || (balancer->names = strdup(list)) == NULL) {
+        free(balancer);
+        return NULL;
+    }
+    for (rest = balancer->names; (name = strsep(&rest, ",")) != NULL; ) {
+        if (*name == '\0') {
+            continue;
+        }
+        if (balancer->count == BALANCE_MAX) {
+            errno = E2BIG;
+            balanceClose(balancer);
+            return NULL;
+        }
+        endpoint = &balancer->endpoints[balancer->count];
+        endpoint->name = name;
+        if (endpointAddress(name, &endpoint->address, &endpoint->addressLength) < 0) {
+            balanceClose(balancer);
+            return NULL;
+        }
+        balancer->count++;
+    }
+    if (balancer->count == 0) {
+        errno = EINVAL;
+        balanceClose(balancer);
+        return NULL;
+    }
+    balancer->seed = ((uint32_t) balanceNow() ^ ((uint32_t) getpid() << 16)) | 1;    //never 0, xorshift would stay there
+    return balancer;
+}
+
+
+/***********************************************************
+ * balancePick: picks the endpoint for the next request or
+ *              connection. when every endpoint is backing
+ *              off, the one due back first is tried anyway.
+ *
+ * parameters: balancer.
+ * returns: endpoint index.
+ ***********************************************************/
+
+int balancePick(struct balancer *balancer) {
+    int healthy[BALANCE_MAX];
+    int count = 0, i, first, second;
+    uint64_t now = balanceNow();
+
+    for (i = 0; i < balancer->count; i++) {
+        if (balancer->endpoints[i].downUntil <= now) {
+            healthy[count++] = i;
+        }
+    }
+    if (count == 0) {
+        first = 0;
+        for (i = 1; i < balancer->count; i++) {
+            if (balancer->endpoints[i].downUntil < balancer->endpoints[first].downUntil) {
+                first = i;
+            }
+        }
+        return first;
+    }
+    if (count == 1) {
+        return healthy[0];
+    }
+    first = healthy[balanceRandom(balancer) % count];
+    second = healthy[balanceRandom(balancer) % (count - 1)];
+    if (second == first) {    //draw from the others, so the two differ
+        second = healthy[count - 1];
+    }
+    return balancer->endpoints[second].outstanding < balancer->endpoints[first].outstanding ? second : first;
+}
+
+
+/***********************************************************
+ * balanceFailed: takes an endpoint out of the rotation for
+ *                a backoff.
+ *
+ * parameters: balancer, endpoint index.
+ * returns: none.
+ ***********************************************************/
+
+void balanceFailed(struct balancer *balancer, int endpoint) {
+    struct balanceEndpoint *failed = &balancer->endpoints[endpoint];
+    uint64_t backoff = BALANCE_BACKOFF;
+    int i;
+
+    for (i = 0; i < failed->failures && backoff < BALANCE_BACKOFF_MAX; i++) {
+        backoff *= 2;
+    }
+    failed->failures++;
+    failed->downUntil = balanceNow() + (backoff < BALANCE_BACKOFF_MAX ? backoff : BALANCE_BACKOFF_MAX);
+}
+
+
+/***********************************************************
+ * balanceHealthy: puts an endpoint that answered back in
+ *                 the rotation.
+ *
+ * parameters: balancer, endpoint index.
+ * returns: none.
+ ***********************************************************/
+
+void balanceHealthy(struct balancer *balancer, int endpoint) {
+    balancer->endpoints[endpoint].failures = 0;
+    balancer->endpoints[endpoint].downUntil = 0;
+}
+
+
+/***********************************************************
+ * balanceClose: frees a balancer.
+ *
+ * parameters: balancer.
+ * returns: none.
+ ***********************************************************/
+
+void balanceClose(struct balancer *balancer) {
+    free(balancer->names);
+    free(balancer);
+}
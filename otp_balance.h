@@ -0,0 +1,48 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_balance.h
+ *
+ * Overview:
+ * Client-side load balancing over several daemons. An
+ * endpoint list is comma-separated ports, host:port pairs
+ * or socket paths, e.g. "5701,5703,otp2:5701". Endpoints are
+ * picked by power of two choices: two healthy ones at
+ * random, and whichever has fewer requests outstanding. An
+ * endpoint that fails is skipped for a backoff that doubles
+ * with each failure in a row.
+ ************************************************************/
+
+#ifndef OTP_BALANCE_H
+#define OTP_BALANCE_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define BALANCE_MAX 64                   //endpoints in one list
+#define BALANCE_BACKOFF 100000000ULL     //first backoff, nanoseconds
+#define BALANCE_BACKOFF_MAX 10000000000ULL
+
+struct balanceEndpoint {
+    const char *name;                    //as given in the list
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+    long outstanding;                    //requests or connections on it, kept by the caller
+    int failures;                        //in a row
+    uint64_t downUntil;                  //CLOCK_MONOTONIC nanoseconds, 0 when healthy
+};
+
+struct balancer {
+    struct balanceEndpoint endpoints[BALANCE_MAX];
+    int count;
+    uint32_t seed;
+    char *names;                         //the list, split in place
+};
+
+struct balancer *balanceOpen(const char *list);
+int balancePick(struct balancer *balancer);
+void balanceFailed(struct balancer *balancer, int endpoint);
+void balanceHealthy(struct balancer *balancer, int endpoint);
+void balanceClose(struct balancer *balancer);
+
+#endif
@@ -0,0 +1,308 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_bench.c
+ *
+ * Overview:
+ * Microbenchmarks for the hot loops: every cipher kernel's
+ * encrypt, decrypt, XOR and wire packing from 16 bytes up
+ * to 1 GB, the reference charToInt/intToChar, and keygen's
+ * generator.
+ * Runs pinned to one CPU, warms up and calibrates each case
+ * until a run takes long enough to time, then repeats it
+ * and prints one JSON line per case with the median and
+ * best bytes/s and TSC cycles/byte.
+ ************************************************************/
+
+#define _GNU_SOURCE    //sched_setaffinity
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include "otp_cipher.h"
+#include "otp_random.h"
+
+#define BENCH_MIN_SIZE 16
+#define BENCH_RUNS_MAX 64
+
+struct benchConfig {
+    int cpu;
+    int runs;
+    double minTime;       //seconds one timed run has to last
+    size_t maxSize;
+    const char *kernel;   //only this kernel, NULL for all
+    const char *only;     //only this benchmark, NULL for all
+};
+
+struct benchCase {
+    const char *name;
+    const char *kernel;
+    int (*run)(const struct benchCase *bench, char *message, const char *key, size_t length);
+    const struct cipherKernel *cipher;
+};
+
+static volatile int sink;    //keeps the compiler from dropping results
+static struct randomState rng;
+static unsigned char *packedKey;    //the key packed, input for the unpack case
+
+
+/***********************************************************
+ * runEncrypt / runDecrypt / runXor: one pass of a kernel.
+ *
+ * parameters: case, message, key, length.
+ * returns: kernel result.
+ ***********************************************************/
+
+static int runEncrypt(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    return bench->cipher->encrypt(message, key, length);
+}
+
+static int runDecrypt(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    return bench->cipher->decrypt(message, key, length);
+}
+
+static int runXor(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    return bench->cipher->xorBytes(message, key, length);
+}
+
+
+/***********************************************************
+ * runPack / runUnpack: one pass of a kernel's wire packer,
+ *                      packing the key or unpacking it.
+ *
+ * parameters: case, message (output), key, length in
+ *             symbols.
+ * returns: packer result.
+ ***********************************************************/
+
+static int runPack(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    return bench->cipher->pack((unsigned char *) message, key, length);
+}
+
+static int runUnpack(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    (void) key;
+    return bench->cipher->unpack(message, packedKey, length);
+}
+
+
+/***********************************************************
+ * runCharToInt / runIntToChar: the original char-at-a-time
+ *                              conversions over a buffer.
+ *
+ * parameters: case, message, key (unused), length.
+ * returns: 0.
+ ***********************************************************/
+
+static int runCharToInt(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    int sum = 0;
+    size_t i;
+
+    (void) bench;
+    (void) key;
+    for (i = 0; i < length; i++)
+        sum += charToInt(message[i]);
+    sink = sum;
+    return 0;
+}
+
+static int runIntToChar(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    size_t i;
+
+    (void) bench;
+    (void) key;
+    for (i = 0; i < length; i++)
+        message[i] = intToChar(i % 27);
+    return 0;
+}
+
+
+/***********************************************************
+ * runKeygenText / runKeygenBytes: keygen's generator.
+ *
+ * parameters: case, message (filled with key), key
+ *             (unused), length.
+ * returns: 0.
+ ***********************************************************/
+
+static int runKeygenText(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    (void) bench;
+    (void) key;
+    randomKey(&rng, message, length, &textAlphabet);
+    return 0;
+}
+
+static int runKeygenBytes(const struct benchCase *bench, char *message, const char *key, size_t length) {
+    (void) bench;
+    (void) key;
+    randomKey(&rng, message, length, &byteAlphabet);
+    return 0;
+}
+
+
+/***********************************************************
+ * now: monotonic time.
+ *
+ * parameters: none.
+ * returns: seconds.
+ ***********************************************************/
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/***********************************************************
+ * compareDoubles: qsort order for doubles.
+ *
+ * parameters: two doubles.
+ * returns: sign of a - b.
+ ***********************************************************/
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+
+/***********************************************************
+ * timeCase: warms up and calibrates one case at one size,
+ *           then times the configured number of runs and
+ *           prints the result.
+ *
+ * parameters: case, message, key, length, bench config.
+ * returns: none.
+ ***********************************************************/
+
+static void timeCase(const struct benchCase *bench, char *message, const char *key, size_t length,
+                     const struct benchConfig *config) {
+    double seconds[BENCH_RUNS_MAX], cycles[BENCH_RUNS_MAX], start, elapsed;
+    unsigned long long tsc;
+    long iterations = 1, i;
+    int run;
+
+    while (1) {    //warmup doubles as calibration
+        start = now();
+        for (i = 0; i < iterations; i++)
+            sink = bench->run(bench, message, key, length);
+        elapsed = now() - start;
+        if (sink < 0) {    //a kernel bailing out early would look very fast
+            fprintf(stderr, "otp_bench: ERROR %s %s rejected its input\n", bench->name, bench->kernel);
+            exit(1);
+        }
+        if (elapsed >= config->minTime)
+            break;
+        iterations *= elapsed > 0 && config->minTime / elapsed < 2 ? 2 : elapsed > 0 ? (long) (config->minTime / elapsed) + 1 : 16;
+    }
+
+    for (run = 0; run < config->runs; run++) {
+        start = now();
+        tsc = __rdtsc();
+        for (i = 0; i < iterations; i++)
+            sink = bench->run(bench, message, key, length);
+        cycles[run] = (double) (__rdtsc() - tsc) / ((double) iterations * length);
+        seconds[run] = now() - start;
+    }
+    qsort(seconds, config->runs, sizeof(seconds[0]), compareDoubles);
+    qsort(cycles, config->runs, sizeof(cycles[0]), compareDoubles);
+
+    printf("{\"bench\":\"%s\",\"kernel\":\"%s\",\"size\":%zu,\"cpu\":%d,\"iterations\":%ld,\"runs\":%d,"
+           "\"bytes_per_s_median\":%.0f,\"bytes_per_s_best\":%.0f,"
+           "\"cycles_per_byte_median\":%.4f,\"cycles_per_byte_best\":%.4f}\n",
+           bench->name, bench->kernel, length, config->cpu, iterations, config->runs,
+           iterations * length / seconds[config->runs / 2], iterations * length / seconds[0],
+           cycles[config->runs / 2], cycles[0]);
+    fflush(stdout);
+}
+
+
+/***********************************************************
+ * main: parses the arguments, pins the CPU and runs every
+ *       case at every size.
+ *
+ * parameters: number of arguments, argument array.
+ * returns: exit status.
+ ***********************************************************/
+
+int main(int argc, char *argv[]) {
+    struct benchConfig config = {-1, 5, 0.02, 64 << 20, NULL, NULL};
+    struct benchCase cases[64];
+    cpu_set_t cpus;
+    char *message, *key;
+    size_t size, i;
+    int opt, count = 0, k;
+
+    while ((opt = getopt(argc, argv, "c:r:t:m:k:b:")) != -1) {
+        if (opt == 'c') {
+            config.cpu = atoi(optarg);    //CPU to pin to, the current one by default
+        } else if (opt == 'r' && atoi(optarg) > 0 && atoi(optarg) <= BENCH_RUNS_MAX) {
+            config.runs = atoi(optarg);
+        } else if (opt == 't' && atof(optarg) > 0) {
+            config.minTime = atof(optarg);
+        } else if (opt == 'm' && strtoull(optarg, NULL, 10) >= BENCH_MIN_SIZE) {
+            config.maxSize = strtoull(optarg, NULL, 10);    //largest message, up to 1 GB
+        } else if (opt == 'k') {
+            config.kernel = optarg;
+        } else if (opt == 'b') {
+            config.only = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-c cpu] [-r runs] [-t seconds] [-m maxsize] [-k kernel] [-b bench]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (config.cpu < 0)
+        config.cpu = sched_getcpu();
+    CPU_ZERO(&cpus);
+    CPU_SET(config.cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {    //no migrations mid-run
+        fprintf(stderr, "otp_bench: ERROR pinning to CPU %d\n", config.cpu);
+        exit(1);
+    }
+    if (randomSeed(&rng) < 0) {
+        fprintf(stderr, "otp_bench: ERROR seeding generator\n");
+        exit(1);
+    }
+
+    for (k = 0; k < cipherKernelCount; k++) {
+        if (!cipherKernels[k].supported() || (config.kernel != NULL && strcmp(config.kernel, cipherKernels[k].name) != 0))
+            continue;
+        cases[count++] = (struct benchCase) {"encrypt", cipherKernels[k].name, runEncrypt, &cipherKernels[k]};
+        cases[count++] = (struct benchCase) {"decrypt", cipherKernels[k].name, runDecrypt, &cipherKernels[k]};
+        cases[count++] = (struct benchCase) {"xor", cipherKernels[k].name, runXor, &cipherKernels[k]};
+        cases[count++] = (struct benchCase) {"pack", cipherKernels[k].name, runPack, &cipherKernels[k]};
+        cases[count++] = (struct benchCase) {"unpack", cipherKernels[k].name, runUnpack, &cipherKernels[k]};
+    }
+    cases[count++] = (struct benchCase) {"charToInt", "reference", runCharToInt, NULL};
+    cases[count++] = (struct benchCase) {"intToChar", "reference", runIntToChar, NULL};
+    cases[count++] = (struct benchCase) {"keygen", "text", runKeygenText, NULL};
+    cases[count++] = (struct benchCase) {"keygen", "bytes", runKeygenBytes, NULL};
+
+    message = malloc(config.maxSize);
+    key = malloc(config.maxSize);
+    packedKey = malloc(PACKED_LENGTH(config.maxSize));
+    if (message == NULL || key == NULL || packedKey == NULL) {
+        fprintf(stderr, "otp_bench: ERROR allocating %zu bytes\n", config.maxSize);
+        exit(1);
+    }
+    randomKey(&rng, message, config.maxSize, &textAlphabet);    //also faults every page in
+    randomKey(&rng, key, config.maxSize, &textAlphabet);
+    packText(packedKey, key, config.maxSize);
+
+    for (k = 0; k < count; k++) {
+        if (config.only != NULL && strcmp(config.only, cases[k].name) != 0)
+            continue;
+        for (size = BENCH_MIN_SIZE; size <= config.maxSize; size *= 4) {
+            for (i = 0; i < size; i++)    //XOR and keygen leave bytes the text kernels would reject
+                message[i] = textAlphabet.symbols[(unsigned char) key[i] % textAlphabet.size];
+            timeCase(&cases[k], message, key, size, &config);
+        }
+    }
+    return 0;
+}
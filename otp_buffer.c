@@ -0,0 +1,307 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_buffer.c
+ *
+ * Overview:
+ * Size-classed connection buffers with per-connection and
+ * daemon-wide budgets. A connection is charged the bytes it
+ * asked for, not the class size: classes past the first few
+ * are mapped, so the untouched tail of a class never costs
+ * anything. Recycled buffers are not zeroed; every protocol
+ * writes a byte before it reads it back.
+ *
+ * The daemon-wide total lives in a shared page mapped before
+ * forking. Each process also keeps its own share in a slot
+ * there, so when a worker dies with buffers still charged
+ * the supervisor can hand them back. The free lists are per
+ * process and only touched from the thread serving its
+ * connections.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "otp_buffer.h"
+
+#define BUFFER_MAP_CLASS 17    //128 KiB and up are mapped, so they go back to the kernel when not cached
+#define BUFFER_CLASSES (BUFFER_MAX_CLASS + 1)
+#define BUFFER_SLOTS 1024      //processes that can hold buffers at once
+
+struct bufferSlot {
+    pid_t pid;                 //0 when free
+    size_t used;
+};
+
+struct bufferPage {
+    size_t used;               //bytes charged across every process
+    size_t limit;
+    struct bufferSlot slots[BUFFER_SLOTS];
+};
+
+static struct bufferPage *page;        //NULL without a daemon-wide cap
+static struct bufferSlot *slot;        //this process's share, claimed on first charge
+static size_t connectionLimit;         //0 for no per-connection budget
+static char *freeLists[BUFFER_CLASSES];    //a free buffer's first bytes link to the next
+static size_t cached;                  //bytes on the free lists
+
+
+/***********************************************************
+ * forgetSlot: fork handler, a child starts with no share.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void forgetSlot(void) {
+    slot = NULL;
+}
+
+
+/***********************************************************
+ * bufferOpen: sets the budgets. the cap's shared page must
+ *             be mapped before forking so every worker
+ *             counts against the same total.
+ *
+ * parameters: bytes for the whole daemon, bytes for one
+ *             connection, 0 for no limit.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+int bufferOpen(size_t limit, size_t connectionBudget) {
+    void *mapped;
+
+    connectionLimit = connectionBudget;
+    if (limit == 0) {
+        return 0;
+    }
+    mapped = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return -1;
+    }
+    page = mapped;
+    page->limit = limit;
+    pthread_atfork(NULL, NULL, forgetSlot);
+    return 0;
+}
+
+
+/***********************************************************
+ * sizeClass: finds the smallest class that holds a size.
+ *
+ * parameters: size in bytes.
+ * returns: class, a power of two exponent.
+ ***********************************************************/
+
+static int sizeClass(size_t size) {
+    int class = BUFFER_MIN_CLASS;
+
+    while (class < BUFFER_CLASSES && ((size_t) 1 << class) < size) {
+        class++;
+    }
+    return class;
+}
+
+
+/***********************************************************
+ * charge: counts bytes against the connection's budget and
+ *         the daemon's cap.
+ *
+ * parameters: connection's running total, bytes.
+ * returns: 0, or -1 with errno EMSGSIZE when over the
+ *          connection's budget or ENOBUFS when over the cap
+ *          or when every slot is taken, since a share the
+ *          supervisor can't see could never be handed back.
+ ***********************************************************/
+
+static int charge(size_t *charged, size_t bytes) {
+    pid_t none;
+    int i;
+
+    if (connectionLimit > 0 && *charged + bytes > connectionLimit) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (page != NULL) {
+        for (i = 0; slot == NULL && i < BUFFER_SLOTS; i++) {    //first charge in this process
+            none = 0;
+            if (__atomic_compare_exchange_n(&page->slots[i].pid, &none, getpid(), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                slot = &page->slots[i];
+            }
+        }
+        if (slot == NULL || __atomic_add_fetch(&page->used, bytes, __ATOMIC_RELAXED) > page->limit) {
+            if (slot != NULL) {
+                __atomic_sub_fetch(&page->used, bytes, __ATOMIC_RELAXED);
+            }
+            errno = ENOBUFS;
+            return -1;
+        }
+        __atomic_add_fetch(&slot->used, bytes, __ATOMIC_RELAXED);
+    }
+    *charged += bytes;
+    return 0;
+}
+
+
+/***********************************************************
+ * uncharge: gives bytes back to the connection and the cap.
+ *
+ * parameters: connection's running total, bytes.
+ * returns: none.
+ ***********************************************************/
+
+static void uncharge(size_t *charged, size_t bytes) {
+    if (page != NULL) {
+        __atomic_sub_fetch(&page->used, bytes, __ATOMIC_RELAXED);
+        if (slot != NULL) {
+            __atomic_sub_fetch(&slot->used, bytes, __ATOMIC_RELAXED);
+        }
+    }
+    *charged -= bytes;
+}
+
+
+/***********************************************************
+ * release: hands a buffer of a class back to the system.
+ *
+ * parameters: buffer, class.
+ * returns: none.
+ ***********************************************************/
+
+static void release(char *buffer, int class) {
+    if (class >= BUFFER_MAP_CLASS) {
+        munmap(buffer, (size_t) 1 << class);
+    } else {
+        free(buffer);
+    }
+}
+
+
+/***********************************************************
+ * bufferGet: hands out a buffer of at least size bytes,
+ *            reusing a free one of its class when there is
+ *            one. the contents are not cleared.
+ *
+ * parameters: connection's running total, size.
+ * returns: buffer, or NULL with errno EMSGSIZE (over the
+ *          connection's budget or the largest class), ENOBUFS
+ *          (over the daemon's cap) or ENOMEM.
+ ***********************************************************/
+
+char *bufferGet(size_t *charged, size_t size) {
+    int class = sizeClass(size);
+    char *buffer;
+    void *mapped;
+
+    if (class > BUFFER_MAX_CLASS) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    if (charge(charged, size) < 0) {
+        return NULL;
+    }
+    buffer = freeLists[class];
+    if (buffer != NULL) {    //most recently freed first, its pages are still warm
+        memcpy(&freeLists[class], buffer, sizeof(buffer));
+        cached -= (size_t) 1 << class;
+        return buffer;
+    }
+
+    if (class >= BUFFER_MAP_CLASS) {
+        mapped = mmap(NULL, (size_t) 1 << class, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        buffer = mapped == MAP_FAILED ? NULL : mapped;
+    } else {
+        buffer = malloc((size_t) 1 << class);
+    }
+    if (buffer == NULL) {
+        uncharge(charged, size);
+        errno = ENOMEM;
+    }
+    return buffer;
+}
+
+
+/***********************************************************
+ * bufferPut: returns a buffer to its class's free list, or
+ *            to the system when this process already keeps
+ *            enough.
+ *
+ * parameters: connection's running total, buffer (may be
+ *             NULL), size it was got or resized with.
+ * returns: none.
+ ***********************************************************/
+
+void bufferPut(size_t *charged, char *buffer, size_t size) {
+    int class = sizeClass(size);
+
+    if (buffer == NULL) {
+        return;
+    }
+    uncharge(charged, size);
+    if (cached + ((size_t) 1 << class) > BUFFER_CACHE) {
+        release(buffer, class);
+        return;
+    }
+    memcpy(buffer, &freeLists[class], sizeof(buffer));
+    freeLists[class] = buffer;
+    cached += (size_t) 1 << class;
+}
+
+
+/***********************************************************
+ * bufferResize: changes a buffer's size, moving it to a new
+ *               class only when it no longer fits its own.
+ *
+ * parameters: connection's running total, buffer, current
+ *             size, new size, leading bytes to keep.
+ * returns: the buffer, or NULL as bufferGet with the old
+ *          buffer left as it was.
+ ***********************************************************/
+
+char *bufferResize(size_t *charged, char *buffer, size_t size, size_t newSize, size_t keep) {
+    char *moved;
+
+    if (sizeClass(newSize) == sizeClass(size)) {    //same class, only the charge changes
+        if (newSize > size && charge(charged, newSize - size) < 0) {
+            return NULL;
+        }
+        if (newSize < size) {
+            uncharge(charged, size - newSize);
+        }
+        return buffer;
+    }
+    moved = bufferGet(charged, newSize);
+    if (moved == NULL) {
+        return NULL;
+    }
+    memcpy(moved, buffer, keep);
+    bufferPut(charged, buffer, size);
+    return moved;
+}
+
+
+/***********************************************************
+ * bufferReap: hands back whatever a finished process still
+ *             had charged. safe in a signal handler.
+ *
+ * parameters: process id.
+ * returns: none.
+ ***********************************************************/
+
+void bufferReap(pid_t pid) {
+    int i;
+
+    if (page == NULL) {
+        return;
+    }
+    for (i = 0; i < BUFFER_SLOTS; i++) {
+        if (__atomic_load_n(&page->slots[i].pid, __ATOMIC_ACQUIRE) == pid) {
+            __atomic_sub_fetch(&page->used, __atomic_exchange_n(&page->slots[i].used, 0, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+            __atomic_store_n(&page->slots[i].pid, 0, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
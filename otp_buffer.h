@@ -0,0 +1,32 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_buffer.h
+ *
+ * Overview:
+ * Connection buffers for the daemons. Buffers come from
+ * power-of-two size classes and go back on a free list when
+ * a connection is done with them, so the next request of
+ * that size reuses one without a trip to the kernel. Every
+ * buffer in use is charged to its connection, and with a
+ * cap set to every process of the daemon, so a burst of big
+ * requests is turned away instead of swapping the host.
+ ************************************************************/
+
+#ifndef OTP_BUFFER_H
+#define OTP_BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define BUFFER_MIN_CLASS 12    //4 KiB, smallest buffer handed out
+#define BUFFER_MAX_CLASS 28    //256 MiB, room for the largest packed v2 request
+#define BUFFER_CACHE (64 << 20)    //free bytes each process keeps for reuse
+
+int bufferOpen(size_t limit, size_t connectionBudget);
+char *bufferGet(size_t *charged, size_t size);
+char *bufferResize(size_t *charged, char *buffer, size_t size, size_t newSize, size_t keep);
+void bufferPut(size_t *charged, char *buffer, size_t size);
+void bufferReap(pid_t pid);
+
+#endif
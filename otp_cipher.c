@@ -0,0 +1,833 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_cipher.c
+ *
+ * Overview:
+ * One-time pad kernels. An alphabet is declared once as an
+ * X-macro list of (value, char) pairs; DEFINE_ALPHABET
+ * expands it into compile-time lookup tables and scalar
+ * kernels specialized to its size. The 27-symbol text
+ * alphabet also has vector kernels that map both inputs to
+ * symbols 0-26, add or subtract them mod 27 and map the
+ * result back, checking validity in the same pass. They do
+ * the mod with an unsigned min instead of a division:
+ * min(s, s - 27) picks s - 27 only when it didn't wrap
+ * around. Over all 256 byte values the pad is plain XOR.
+ *
+ * Text can also be packed for the wire: five symbols are
+ * read as the base-27 digits of a number under 27^5 < 2^24
+ * and sent as its three bytes, little end first. The
+ * vector packers line the groups up in 64-bit lanes with a
+ * shuffle, combine digits with multiply-adds, and unpack
+ * by dividing by 27 with a multiply and shift.
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+#include "otp_cipher.h"
+
+#define TEXT_SYMBOLS(X) \
+    X(0, 'A') X(1, 'B') X(2, 'C') X(3, 'D') X(4, 'E') X(5, 'F') X(6, 'G') \
+    X(7, 'H') X(8, 'I') X(9, 'J') X(10, 'K') X(11, 'L') X(12, 'M') X(13, 'N') \
+    X(14, 'O') X(15, 'P') X(16, 'Q') X(17, 'R') X(18, 'S') X(19, 'T') X(20, 'U') \
+    X(21, 'V') X(22, 'W') X(23, 'X') X(24, 'Y') X(25, 'Z') X(26, ' ')
+
+#define PACK_LIMIT 14348907      //27^5, the first value five symbols can't reach
+#define PACK_DIVIDE 19884108     //ceil(2^29 / 27): (v * PACK_DIVIDE) >> 29 is v / 27 for any v < 2^24
+
+#define SYMBOL_CODE(value, c) [(unsigned char) (c)] = (value) + 1,    //0 marks chars outside the alphabet
+#define SYMBOL_CHAR(value, c) (c),
+#define SYMBOL_COUNT(value, c) + 1
+
+/***********************************************************
+ * DEFINE_ALPHABET: defines <name>Code, <name>Symbols,
+ *                  <name>Size, <name>Encrypt and
+ *                  <name>Decrypt for an alphabet list. the
+ *                  size is a constant, so the mod compiles
+ *                  down to a compare and subtract.
+ ***********************************************************/
+
+#define DEFINE_ALPHABET(name, SYMBOLS) \
+static const unsigned char name##Code[256] = { SYMBOLS(SYMBOL_CODE) }; \
+static const char name##Symbols[] = { SYMBOLS(SYMBOL_CHAR) '\0' }; \
+enum { name##Size = 0 SYMBOLS(SYMBOL_COUNT) }; \
+\
+static int name##Encrypt(char *message, const char *key, size_t length) { \
+    unsigned int a, b, s, invalid = 0; \
+    size_t i; \
+    for (i = 0; i < length; i++) { \
+        a = name##Code[(unsigned char) message[i]]; \
+        b = name##Code[(unsigned char) key[i]]; \
+        invalid |= (a == 0) | (b == 0); \
+        s = a + b - 2; \
+        s -= s >= name##Size ? name##Size : 0; \
+        message[i] = name##Symbols[s % name##Size];    /* % only keeps invalid input in bounds */ \
+    } \
+    return invalid ? -1 : 0; \
+} \
+\
+static int name##Decrypt(char *message, const char *key, size_t length) { \
+    unsigned int a, b, d, invalid = 0; \
+    size_t i; \
+    for (i = 0; i < length; i++) { \
+        a = name##Code[(unsigned char) message[i]]; \
+        b = name##Code[(unsigned char) key[i]]; \
+        invalid |= (a == 0) | (b == 0); \
+        d = a + name##Size - b; \
+        d -= d >= name##Size ? name##Size : 0; \
+        message[i] = name##Symbols[d % name##Size]; \
+    } \
+    return invalid ? -1 : 0; \
+}
+
+DEFINE_ALPHABET(text, TEXT_SYMBOLS)
+
+
+/***********************************************************
+ * charToInt: turns a char into an int.
+ *
+ * parameters: char.
+ * returns: int.
+ ***********************************************************/
+
+int charToInt(char c) {
+    if (c == ' ') {
+        return 26;
+    } else {
+        return (c - 'A');
+    }
+}
+
+
+/***********************************************************
+ * intToChar: turns an int into a char.
+ *
+ * parameters: int.
+ * returns: char.
+ ***********************************************************/
+
+char intToChar(int i) {
+    if (i == 26) {
+        return ' ';
+    } else {
+        return (i + 'A');
+    }
+}
+
+
+/***********************************************************
+ * validChar: checks that a char is A-Z or a space.
+ *
+ * parameters: char.
+ * returns: 1 if valid, 0 if not.
+ ***********************************************************/
+
+static int validChar(char c) {
+    return c == ' ' || (c >= 'A' && c <= 'Z');
+}
+
+
+/***********************************************************
+ * encryptReference: the original char-at-a-time encrypt,
+ *                   kept as the answer key for the self
+ *                   check.
+ *
+ * parameters: message, key, length.
+ * returns: 0 on success, -1 on an invalid char.
+ ***********************************************************/
+
+static int encryptReference(char *message, const char *key, size_t length) {
+    size_t i;
+    for (i = 0; i < length; i++) {
+        if (!validChar(message[i]) || !validChar(key[i])) {
+            return -1;
+        }
+        message[i] = intToChar((charToInt(message[i]) + charToInt(key[i])) % 27);    //encrypt using key
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * decryptReference: the original char-at-a-time decrypt.
+ *
+ * parameters: message, key, length.
+ * returns: 0 on success, -1 on an invalid char.
+ ***********************************************************/
+
+static int decryptReference(char *message, const char *key, size_t length) {
+    size_t i;
+    int c;
+    for (i = 0; i < length; i++) {
+        if (!validChar(message[i]) || !validChar(key[i])) {
+            return -1;
+        }
+        c = charToInt(message[i]) - charToInt(key[i]);    //decrypt using key
+        if (c < 0) {
+            c += 27;
+        }
+        message[i] = intToChar(c);
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * xorScalar: XORs the key into the message a word at a
+ *            time.
+ *
+ * parameters: message, key, length.
+ * returns: 0.
+ ***********************************************************/
+
+static int xorScalar(char *message, const char *key, size_t length) {
+    uint64_t m, k;
+    size_t i;
+    for (i = 0; i + 8 <= length; i += 8) {
+        memcpy(&m, message + i, 8);
+        memcpy(&k, key + i, 8);
+        m ^= k;
+        memcpy(message + i, &m, 8);
+    }
+    for (; i < length; i++) {
+        message[i] ^= key[i];
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * packScalar: packs text five symbols to three bytes. the
+ *             last group is padded with zero digits.
+ *             packed may be the text itself.
+ *
+ * parameters: packed output (PACKED_LENGTH bytes), text,
+ *             number of symbols.
+ * returns: 0 on success, -1 on an invalid char.
+ ***********************************************************/
+
+static int packScalar(unsigned char *packed, const char *text, size_t length) {
+    uint32_t group, place;
+    unsigned int code;
+    size_t i, j;
+    for (i = 0; i < length; i += 5) {
+        group = 0;
+        place = 1;
+        for (j = i; j < i + 5 && j < length; j++) {
+            code = textCode[(unsigned char) text[j]];
+            if (code == 0) {
+                return -1;
+            }
+            group += (code - 1) * place;
+            place *= textSize;
+        }
+        *packed++ = group;
+        *packed++ = group >> 8;
+        *packed++ = group >> 16;
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * unpackScalar: turns packed groups back into text.
+ *
+ * parameters: text output, packed input, number of
+ *             symbols.
+ * returns: 0 on success, -1 if a group is 27^5 or more.
+ ***********************************************************/
+
+static int unpackScalar(char *text, const unsigned char *packed, size_t length) {
+    uint32_t group;
+    size_t i, j;
+    for (i = 0; i < length; i += 5, packed += 3) {
+        group = packed[0] | (uint32_t) packed[1] << 8 | (uint32_t) packed[2] << 16;
+        if (group >= PACK_LIMIT) {
+            return -1;
+        }
+        for (j = i; j < i + 5 && j < length; j++) {
+            text[j] = textSymbols[group % textSize];
+            group /= textSize;
+        }
+    }
+    return 0;
+}
+
+
+static int scalarSupported(void) {
+    return 1;
+}
+
+
+/***********************************************************
+ * SSE4.2 kernels: 16 chars per step.
+ ***********************************************************/
+
+static int sseSupported(void) {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i toSymbolsSSE(__m128i c, __m128i *good) {
+    __m128i v = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+    __m128i isSpace = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+    __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(25)), v);
+    *good = _mm_and_si128(*good, _mm_or_si128(isSpace, isLetter));
+    return _mm_blendv_epi8(v, _mm_set1_epi8(26), isSpace);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i fromSymbolsSSE(__m128i v) {
+    __m128i isSpace = _mm_cmpeq_epi8(v, _mm_set1_epi8(26));
+    return _mm_blendv_epi8(_mm_add_epi8(v, _mm_set1_epi8('A')), _mm_set1_epi8(' '), isSpace);
+}
+
+__attribute__((target("sse4.2")))
+static int encryptSSE(char *message, const char *key, size_t length) {
+    __m128i good = _mm_set1_epi8(-1), m, k, s;
+    size_t i;
+    for (i = 0; i + 16 <= length; i += 16) {
+        m = toSymbolsSSE(_mm_loadu_si128((const __m128i *) (message + i)), &good);
+        k = toSymbolsSSE(_mm_loadu_si128((const __m128i *) (key + i)), &good);
+        s = _mm_add_epi8(m, k);
+        s = _mm_min_epu8(s, _mm_sub_epi8(s, _mm_set1_epi8(27)));
+        _mm_storeu_si128((__m128i *) (message + i), fromSymbolsSSE(s));
+    }
+    if (_mm_movemask_epi8(good) != 0xFFFF) {
+        return -1;
+    }
+    return textEncrypt(message + i, key + i, length - i);
+}
+
+__attribute__((target("sse4.2")))
+static int decryptSSE(char *message, const char *key, size_t length) {
+    __m128i good = _mm_set1_epi8(-1), m, k, d;
+    size_t i;
+    for (i = 0; i + 16 <= length; i += 16) {
+        m = toSymbolsSSE(_mm_loadu_si128((const __m128i *) (message + i)), &good);
+        k = toSymbolsSSE(_mm_loadu_si128((const __m128i *) (key + i)), &good);
+        d = _mm_sub_epi8(m, k);
+        d = _mm_min_epu8(d, _mm_add_epi8(d, _mm_set1_epi8(27)));
+        _mm_storeu_si128((__m128i *) (message + i), fromSymbolsSSE(d));
+    }
+    if (_mm_movemask_epi8(good) != 0xFFFF) {
+        return -1;
+    }
+    return textDecrypt(message + i, key + i, length - i);
+}
+
+__attribute__((target("sse4.2")))
+static int xorSSE(char *message, const char *key, size_t length) {
+    __m128i m, k;
+    size_t i;
+    for (i = 0; i + 16 <= length; i += 16) {
+        m = _mm_loadu_si128((const __m128i *) (message + i));
+        k = _mm_loadu_si128((const __m128i *) (key + i));
+        _mm_storeu_si128((__m128i *) (message + i), _mm_xor_si128(m, k));
+    }
+    return xorScalar(message + i, key + i, length - i);
+}
+
+
+__attribute__((target("sse4.2")))
+static inline __m128i packGroupsSSE(__m128i s) {    //two groups of five symbols, one per 64-bit lane
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1);
+    const __m128i pairs = _mm_setr_epi8(1, 27, 1, 27, 1, 0, 0, 0, 1, 27, 1, 27, 1, 0, 0, 0);
+    const __m128i quads = _mm_setr_epi16(1, 729, 1, 0, 1, 729, 1, 0);
+    __m128i d = _mm_madd_epi16(_mm_maddubs_epi16(_mm_shuffle_epi8(s, spread), pairs), quads);    //s0..s3 low, s4 high
+    return _mm_add_epi32(d, _mm_mul_epu32(_mm_srli_epi64(d, 32), _mm_set1_epi64x(531441)));
+}
+
+__attribute__((target("sse4.2")))
+static int packSSE(unsigned char *packed, const char *text, size_t length) {
+    const __m128i gather = _mm_setr_epi8(0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i good = _mm_set1_epi8(-1), s;
+    size_t i, o = 0;
+    for (i = 0; i + 16 <= length; i += 10, o += 6) {    //reads run ahead of writes, so in place is safe
+        s = toSymbolsSSE(_mm_loadu_si128((const __m128i *) (text + i)), &good);
+        _mm_storel_epi64((__m128i *) (packed + o), _mm_shuffle_epi8(packGroupsSSE(s), gather));
+    }
+    if (_mm_movemask_epi8(good) != 0xFFFF) {
+        return -1;
+    }
+    return packScalar(packed + o, text + i, length - i);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i digitSSE(__m128i *v) {    //v % 27, leaving v / 27
+    __m128i q = _mm_srli_epi64(_mm_mul_epu32(*v, _mm_set1_epi64x(PACK_DIVIDE)), 29);
+    __m128i r = _mm_sub_epi32(*v, _mm_mullo_epi32(q, _mm_set1_epi32(27)));
+    *v = q;
+    return r;
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i unpackGroupsSSE(__m128i v, __m128i *bad) {    //one group per 64-bit lane to five symbol bytes
+    __m128i digits;
+    *bad = _mm_or_si128(*bad, _mm_cmpgt_epi32(v, _mm_set1_epi32(PACK_LIMIT - 1)));
+    digits = digitSSE(&v);
+    digits = _mm_or_si128(digits, _mm_slli_epi64(digitSSE(&v), 8));
+    digits = _mm_or_si128(digits, _mm_slli_epi64(digitSSE(&v), 16));
+    digits = _mm_or_si128(digits, _mm_slli_epi64(digitSSE(&v), 24));
+    return _mm_or_si128(digits, _mm_slli_epi64(v, 32));
+}
+
+__attribute__((target("sse4.2")))
+static int unpackSSE(char *text, const unsigned char *packed, size_t length) {
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, -1, -1, -1, -1, 3, 4, 5, -1, -1, -1, -1, -1);
+    const __m128i gather = _mm_setr_epi8(0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1);
+    __m128i bad = _mm_setzero_si128(), v;
+    size_t i, o = 0;
+    for (i = 0; i + 16 <= length; i += 10, o += 6) {
+        v = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *) (packed + o)), spread);
+        _mm_storeu_si128((__m128i *) (text + i), fromSymbolsSSE(_mm_shuffle_epi8(unpackGroupsSSE(v, &bad), gather)));
+    }
+    if (_mm_movemask_epi8(bad) != 0) {
+        return -1;
+    }
+    return unpackScalar(text + i, packed + o, length - i);
+}
+
+
+/***********************************************************
+ * AVX2 kernels: 32 chars per step.
+ ***********************************************************/
+
+static int avx2Supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static inline __m256i toSymbolsAVX2(__m256i c, __m256i *good) {
+    __m256i v = _mm256_sub_epi8(c, _mm256_set1_epi8('A'));
+    __m256i isSpace = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+    __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(25)), v);
+    *good = _mm256_and_si256(*good, _mm256_or_si256(isSpace, isLetter));
+    return _mm256_blendv_epi8(v, _mm256_set1_epi8(26), isSpace);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fromSymbolsAVX2(__m256i v) {
+    __m256i isSpace = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(26));
+    return _mm256_blendv_epi8(_mm256_add_epi8(v, _mm256_set1_epi8('A')), _mm256_set1_epi8(' '), isSpace);
+}
+
+__attribute__((target("avx2")))
+static int encryptAVX2(char *message, const char *key, size_t length) {
+    __m256i good = _mm256_set1_epi8(-1), m, k, s;
+    size_t i;
+    for (i = 0; i + 32 <= length; i += 32) {
+        m = toSymbolsAVX2(_mm256_loadu_si256((const __m256i *) (message + i)), &good);
+        k = toSymbolsAVX2(_mm256_loadu_si256((const __m256i *) (key + i)), &good);
+        s = _mm256_add_epi8(m, k);
+        s = _mm256_min_epu8(s, _mm256_sub_epi8(s, _mm256_set1_epi8(27)));
+        _mm256_storeu_si256((__m256i *) (message + i), fromSymbolsAVX2(s));
+    }
+    if (_mm256_movemask_epi8(good) != -1) {
+        return -1;
+    }
+    return encryptSSE(message + i, key + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static int decryptAVX2(char *message, const char *key, size_t length) {
+    __m256i good = _mm256_set1_epi8(-1), m, k, d;
+    size_t i;
+    for (i = 0; i + 32 <= length; i += 32) {
+        m = toSymbolsAVX2(_mm256_loadu_si256((const __m256i *) (message + i)), &good);
+        k = toSymbolsAVX2(_mm256_loadu_si256((const __m256i *) (key + i)), &good);
+        d = _mm256_sub_epi8(m, k);
+        d = _mm256_min_epu8(d, _mm256_add_epi8(d, _mm256_set1_epi8(27)));
+        _mm256_storeu_si256((__m256i *) (message + i), fromSymbolsAVX2(d));
+    }
+    if (_mm256_movemask_epi8(good) != -1) {
+        return -1;
+    }
+    return decryptSSE(message + i, key + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static int xorAVX2(char *message, const char *key, size_t length) {
+    __m256i m, k;
+    size_t i;
+    for (i = 0; i + 32 <= length; i += 32) {
+        m = _mm256_loadu_si256((const __m256i *) (message + i));
+        k = _mm256_loadu_si256((const __m256i *) (key + i));
+        _mm256_storeu_si256((__m256i *) (message + i), _mm256_xor_si256(m, k));
+    }
+    return xorSSE(message + i, key + i, length - i);
+}
+
+
+__attribute__((target("avx2")))
+static int packAVX2(unsigned char *packed, const char *text, size_t length) {
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1,
+                                            0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1);
+    const __m256i pairs = _mm256_setr_epi8(1, 27, 1, 27, 1, 0, 0, 0, 1, 27, 1, 27, 1, 0, 0, 0,
+                                           1, 27, 1, 27, 1, 0, 0, 0, 1, 27, 1, 27, 1, 0, 0, 0);
+    const __m256i quads = _mm256_setr_epi16(1, 729, 1, 0, 1, 729, 1, 0, 1, 729, 1, 0, 1, 729, 1, 0);
+    const __m256i gather = _mm256_setr_epi8(0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m256i good = _mm256_set1_epi8(-1), s, d;
+    size_t i, o = 0;
+    for (i = 0; i + 26 <= length; i += 20, o += 12) {    //each lane takes ten symbols
+        s = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (text + i))),
+                                    _mm_loadu_si128((const __m128i *) (text + i + 10)), 1);
+        s = toSymbolsAVX2(s, &good);
+        d = _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(s, spread), pairs), quads);
+        d = _mm256_add_epi32(d, _mm256_mul_epu32(_mm256_srli_epi64(d, 32), _mm256_set1_epi64x(531441)));
+        d = _mm256_shuffle_epi8(d, gather);
+        _mm_storel_epi64((__m128i *) (packed + o), _mm256_castsi256_si128(d));
+        _mm_storel_epi64((__m128i *) (packed + o + 6), _mm256_extracti128_si256(d, 1));
+    }
+    if (_mm256_movemask_epi8(good) != -1) {
+        return -1;
+    }
+    return packSSE(packed + o, text + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i digitAVX2(__m256i *v) {
+    __m256i q = _mm256_srli_epi64(_mm256_mul_epu32(*v, _mm256_set1_epi64x(PACK_DIVIDE)), 29);
+    __m256i r = _mm256_sub_epi32(*v, _mm256_mullo_epi32(q, _mm256_set1_epi32(27)));
+    *v = q;
+    return r;
+}
+
+__attribute__((target("avx2")))
+static int unpackAVX2(char *text, const unsigned char *packed, size_t length) {
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, -1, -1, -1, -1, 3, 4, 5, -1, -1, -1, -1, -1,
+                                            0, 1, 2, -1, -1, -1, -1, -1, 3, 4, 5, -1, -1, -1, -1, -1);
+    const __m256i gather = _mm256_setr_epi8(0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1,
+                                            0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1);
+    __m256i bad = _mm256_setzero_si256(), v, digits;
+    size_t i, o = 0;
+    for (i = 0; i + 26 <= length; i += 20, o += 12) {
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *) (packed + o))),
+                                    _mm_loadl_epi64((const __m128i *) (packed + o + 6)), 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(v, _mm256_set1_epi32(PACK_LIMIT - 1)));
+        digits = digitAVX2(&v);
+        digits = _mm256_or_si256(digits, _mm256_slli_epi64(digitAVX2(&v), 8));
+        digits = _mm256_or_si256(digits, _mm256_slli_epi64(digitAVX2(&v), 16));
+        digits = _mm256_or_si256(digits, _mm256_slli_epi64(digitAVX2(&v), 24));
+        digits = _mm256_or_si256(digits, _mm256_slli_epi64(v, 32));
+        digits = fromSymbolsAVX2(_mm256_shuffle_epi8(digits, gather));
+        _mm_storeu_si128((__m128i *) (text + i), _mm256_castsi256_si128(digits));    //the second store covers the first's spare bytes
+        _mm_storeu_si128((__m128i *) (text + i + 10), _mm256_extracti128_si256(digits, 1));
+    }
+    if (_mm256_movemask_epi8(bad) != 0) {
+        return -1;
+    }
+    return unpackSSE(text + i, packed + o, length - i);
+}
+
+
+/***********************************************************
+ * AVX-512 kernels: 64 chars per step, using mask registers
+ * for the compares and the tail.
+ ***********************************************************/
+
+static int avx512Supported(void) {
+    return __builtin_cpu_supports("avx512bw");
+}
+
+__attribute__((target("avx512bw")))
+static inline __m512i toSymbolsAVX512(__m512i c, __mmask64 *good) {
+    __m512i v = _mm512_sub_epi8(c, _mm512_set1_epi8('A'));
+    __mmask64 isSpace = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8(' '));
+    __mmask64 isLetter = _mm512_cmple_epu8_mask(v, _mm512_set1_epi8(25));
+    *good &= isSpace | isLetter;
+    return _mm512_mask_blend_epi8(isSpace, v, _mm512_set1_epi8(26));
+}
+
+__attribute__((target("avx512bw")))
+static inline __m512i fromSymbolsAVX512(__m512i v) {
+    __mmask64 isSpace = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(26));
+    return _mm512_mask_blend_epi8(isSpace, _mm512_add_epi8(v, _mm512_set1_epi8('A')), _mm512_set1_epi8(' '));
+}
+
+__attribute__((target("avx512bw")))
+static int encryptAVX512(char *message, const char *key, size_t length) {
+    __mmask64 good = ~(__mmask64) 0, ok, lanes;
+    __m512i m, k, s;
+    size_t i;
+    for (i = 0; i < length; i += 64) {
+        lanes = length - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (length - i)) - 1;    //masked tail, no scalar loop
+        ok = ~(__mmask64) 0;
+        m = toSymbolsAVX512(_mm512_maskz_loadu_epi8(lanes, message + i), &ok);
+        k = toSymbolsAVX512(_mm512_maskz_loadu_epi8(lanes, key + i), &ok);
+        good &= ok | ~lanes;    //lanes past the end don't count
+        s = _mm512_add_epi8(m, k);
+        s = _mm512_min_epu8(s, _mm512_sub_epi8(s, _mm512_set1_epi8(27)));
+        _mm512_mask_storeu_epi8(message + i, lanes, fromSymbolsAVX512(s));
+    }
+    return good == ~(__mmask64) 0 ? 0 : -1;
+}
+
+__attribute__((target("avx512bw")))
+static int decryptAVX512(char *message, const char *key, size_t length) {
+    __mmask64 good = ~(__mmask64) 0, ok, lanes;
+    __m512i m, k, d;
+    size_t i;
+    for (i = 0; i < length; i += 64) {
+        lanes = length - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (length - i)) - 1;
+        ok = ~(__mmask64) 0;
+        m = toSymbolsAVX512(_mm512_maskz_loadu_epi8(lanes, message + i), &ok);
+        k = toSymbolsAVX512(_mm512_maskz_loadu_epi8(lanes, key + i), &ok);
+        good &= ok | ~lanes;
+        d = _mm512_sub_epi8(m, k);
+        d = _mm512_min_epu8(d, _mm512_add_epi8(d, _mm512_set1_epi8(27)));
+        _mm512_mask_storeu_epi8(message + i, lanes, fromSymbolsAVX512(d));
+    }
+    return good == ~(__mmask64) 0 ? 0 : -1;
+}
+
+__attribute__((target("avx512bw")))
+static int xorAVX512(char *message, const char *key, size_t length) {
+    __mmask64 lanes;
+    __m512i m, k;
+    size_t i;
+    for (i = 0; i < length; i += 64) {
+        lanes = length - i >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << (length - i)) - 1;
+        m = _mm512_maskz_loadu_epi8(lanes, message + i);
+        k = _mm512_maskz_loadu_epi8(lanes, key + i);
+        _mm512_mask_storeu_epi8(message + i, lanes, _mm512_xor_si512(m, k));
+    }
+    return 0;
+}
+
+
+const struct cipherKernel cipherKernels[] = {
+    {"avx512", avx512Supported, encryptAVX512, decryptAVX512, xorAVX512, packAVX2, unpackAVX2},    //AVX-512BW CPUs all have AVX2
+    {"avx2", avx2Supported, encryptAVX2, decryptAVX2, xorAVX2, packAVX2, unpackAVX2},
+    {"sse4.2", sseSupported, encryptSSE, decryptSSE, xorSSE, packSSE, unpackSSE},
+    {"scalar", scalarSupported, textEncrypt, textDecrypt, xorScalar, packScalar, unpackScalar}
+};
+const int cipherKernelCount = sizeof(cipherKernels) / sizeof(cipherKernels[0]);
+
+static const struct cipherKernel *activeKernel = &cipherKernels[sizeof(cipherKernels) / sizeof(cipherKernels[0]) - 1];
+
+
+/***********************************************************
+ * cipherSelfCheck: runs a kernel against the reference code
+ *                  on every length up to a few vectors, at
+ *                  odd offsets, and checks that it catches
+ *                  an invalid char anywhere in either input.
+ *                  the XOR kernel and the packers are
+ *                  checked the same way.
+ *
+ * parameters: kernel.
+ * returns: 0 if it matches, -1 if not.
+ ***********************************************************/
+
+int cipherSelfCheck(const struct cipherKernel *kernel) {
+    static char message[300], key[300], expected[300], actual[300];
+    static unsigned char packed[300], packedExpected[300];
+    uint32_t seed = 12345;
+    size_t length, offset, i;
+    int decrypting;
+
+    for (length = 0; length + 3 <= sizeof(message); length++) {
+        offset = length % 3;    //catch alignment assumptions
+        for (i = 0; i < length + offset; i++) {
+            seed = seed * 1103515245 + 12345;
+            message[i] = textSymbols[(seed >> 16) % textSize];
+            seed = seed * 1103515245 + 12345;
+            key[i] = textSymbols[(seed >> 16) % textSize];
+        }
+
+        for (decrypting = 0; decrypting < 2; decrypting++) {
+            memcpy(expected, message + offset, length);
+            memcpy(actual, message + offset, length);
+            if (decrypting) {
+                decryptReference(expected, key + offset, length);
+                if (kernel->decrypt(actual, key + offset, length) != 0) {
+                    return -1;
+                }
+            } else {
+                encryptReference(expected, key + offset, length);
+                if (kernel->encrypt(actual, key + offset, length) != 0) {
+                    return -1;
+                }
+            }
+            if (memcmp(expected, actual, length) != 0) {
+                return -1;
+            }
+        }
+
+        if (packScalar(packedExpected, message + offset, length) != 0 || kernel->pack(packed, message + offset, length) != 0 ||
+            memcmp(packedExpected, packed, PACKED_LENGTH(length)) != 0) {
+            return -1;
+        }
+        memcpy(actual, message + offset, length);    //in place, the way the daemon packs a reply
+        if (kernel->pack((unsigned char *) actual, actual, length) != 0 || memcmp(packedExpected, actual, PACKED_LENGTH(length)) != 0) {
+            return -1;
+        }
+        if (kernel->unpack(actual, packed, length) != 0 || memcmp(actual, message + offset, length) != 0) {
+            return -1;
+        }
+
+        if (length > 0) {    //one bad char in the message, then one in the key
+            i = (seed >> 8) % length;
+            memcpy(actual, message + offset, length);
+            actual[i] = (seed & 1) ? 'a' : '\n';
+            if (kernel->pack(packed, actual, length) != -1) {
+                return -1;
+            }
+            if (kernel->encrypt(actual, key + offset, length) != -1) {
+                return -1;
+            }
+            memcpy(packed, packedExpected, PACKED_LENGTH(length));    //and a group past 27^5
+            packed[i / 5 * 3 + 2] = 0xFF;
+            if (kernel->unpack(actual, packed, length) != -1) {
+                return -1;
+            }
+            memcpy(actual, key + offset, length);
+            actual[i] = (char) 0xC1;
+            memcpy(expected, message + offset, length);
+            if (kernel->decrypt(expected, actual, length) != -1) {
+                return -1;
+            }
+        }
+
+        for (i = 0; i < length + offset; i++) {    //XOR covers every byte value
+            seed = seed * 1103515245 + 12345;
+            key[i] = (char) (seed >> 13);
+        }
+        memcpy(actual, message + offset, length);
+        for (i = 0; i < length; i++) {
+            expected[i] = message[offset + i] ^ key[offset + i];
+        }
+        if (kernel->xorBytes(actual, key + offset, length) != 0 || memcmp(expected, actual, length) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * cipherSelect: picks the kernel for this process: the
+ *               first one the CPU supports that passes the
+ *               self check, or the named one if given.
+ *
+ * parameters: kernel name, or NULL for the best available.
+ * returns: selected kernel, NULL if the named one can't be
+ *          used.
+ ***********************************************************/
+
+const struct cipherKernel *cipherSelect(const char *name) {
+    int i;
+    for (i = 0; i < cipherKernelCount; i++) {
+        if (name != NULL && strcmp(name, cipherKernels[i].name) != 0) {
+            continue;
+        }
+        if (!cipherKernels[i].supported()) {
+            continue;
+        }
+        if (cipherSelfCheck(&cipherKernels[i]) != 0) {
+            fprintf(stderr, "cipher: %s kernel failed its self check, skipping it\n", cipherKernels[i].name);
+            continue;
+        }
+        activeKernel = &cipherKernels[i];
+        return activeKernel;
+    }
+    return NULL;
+}
+
+
+/***********************************************************
+ * encryptMessage: encrypts the message in place with the
+ *                 selected kernel.
+ *
+ * parameters: message, key, length.
+ * returns: 0 on success, -1 if either input holds a char
+ *          outside A-Z and space.
+ ***********************************************************/
+
+int encryptMessage(char *message, const char *key, size_t length) {
+    return activeKernel->encrypt(message, key, length);
+}
+
+
+/***********************************************************
+ * xorMessage: XORs the key into the message with the
+ *             selected kernel.
+ *
+ * parameters: message, key, length.
+ * returns: 0.
+ ***********************************************************/
+
+int xorMessage(char *message, const char *key, size_t length) {
+    return activeKernel->xorBytes(message, key, length);
+}
+
+
+/***********************************************************
+ * packText: packs text for the wire with the selected
+ *           kernel. packed may be the text itself.
+ *
+ * parameters: output of PACKED_LENGTH(length) bytes, text,
+ *             length.
+ * returns: 0 on success, -1 on a char outside A-Z and space.
+ ***********************************************************/
+
+int packText(unsigned char *packed, const char *text, size_t length) {
+    return activeKernel->pack(packed, text, length);
+}
+
+
+/***********************************************************
+ * unpackText: turns packed bytes back into text.
+ *
+ * parameters: text output, packed input, length in symbols.
+ * returns: 0 on success, -1 on a group no text packs to.
+ ***********************************************************/
+
+int unpackText(char *text, const unsigned char *packed, size_t length) {
+    return activeKernel->unpack(text, packed, length);
+}
+
+
+/***********************************************************
+ * decryptMessage: decrypts the message in place with the
+ *                 selected kernel.
+ *
+ * parameters: message, key, length.
+ * returns: 0 on success, -1 if either input holds a char
+ *          outside A-Z and space.
+ ***********************************************************/
+
+int decryptMessage(char *message, const char *key, size_t length) {
+    return activeKernel->decrypt(message, key, length);
+}
+
+
+const struct cipherAlphabet textAlphabet = {"text", textSize, textSymbols, textCode, encryptMessage, decryptMessage};
+const struct cipherAlphabet byteAlphabet = {"bytes", 256, NULL, NULL, xorMessage, xorMessage};
+
+
+/***********************************************************
+ * cipherValid: checks that text only holds symbols of the
+ *              alphabet.
+ *
+ * parameters: alphabet, text, length.
+ * returns: 1 if valid, 0 if not.
+ ***********************************************************/
+
+int cipherValid(const struct cipherAlphabet *alphabet, const char *text, size_t length) {
+    size_t i;
+    if (alphabet->code == NULL) {    //every byte is a symbol
+        return 1;
+    }
+    for (i = 0; i < length; i++) {
+        if (alphabet->code[(unsigned char) text[i]] == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
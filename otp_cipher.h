@@ -0,0 +1,59 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_cipher.h
+ *
+ * Overview:
+ * The one-time pad transform. Text uses the 27-symbol
+ * alphabet (A-Z and space) and binary data uses all 256
+ * byte values, where the pad reduces to XOR. There is a
+ * scalar kernel and SSE4.2, AVX2 and AVX-512 kernels; the
+ * best one the CPU supports is picked once at startup.
+ * Every text kernel also checks that the message and key
+ * hold only valid symbols. Text can be packed five
+ * symbols to three bytes for the wire.
+ ************************************************************/
+
+#ifndef OTP_CIPHER_H
+#define OTP_CIPHER_H
+
+#include <stddef.h>
+
+#define PACKED_LENGTH(symbols) (((symbols) + 4) / 5 * 3)    //bytes five-to-three packing takes
+
+struct cipherKernel {
+    const char *name;
+    int (*supported)(void);
+    int (*encrypt)(char *message, const char *key, size_t length);
+    int (*decrypt)(char *message, const char *key, size_t length);
+    int (*xorBytes)(char *message, const char *key, size_t length);
+    int (*pack)(unsigned char *packed, const char *text, size_t length);
+    int (*unpack)(char *text, const unsigned char *packed, size_t length);
+};
+
+struct cipherAlphabet {
+    const char *name;
+    int size;
+    const char *symbols;           //symbol for each value, NULL when every byte is a symbol
+    const unsigned char *code;     //value + 1 for each char, 0 if outside the alphabet
+    int (*encrypt)(char *message, const char *key, size_t length);
+    int (*decrypt)(char *message, const char *key, size_t length);
+};
+
+extern const struct cipherKernel cipherKernels[];    //best first, scalar last
+extern const int cipherKernelCount;
+extern const struct cipherAlphabet textAlphabet;    //A-Z and space, mod 27
+extern const struct cipherAlphabet byteAlphabet;    //any byte, XOR
+
+int charToInt(char c);
+char intToChar(int i);
+int cipherSelfCheck(const struct cipherKernel *kernel);
+const struct cipherKernel *cipherSelect(const char *name);
+int encryptMessage(char *message, const char *key, size_t length);
+int decryptMessage(char *message, const char *key, size_t length);
+int xorMessage(char *message, const char *key, size_t length);
+int packText(unsigned char *packed, const char *text, size_t length);
+int unpackText(char *text, const unsigned char *packed, size_t length);
+int cipherValid(const struct cipherAlphabet *alphabet, const char *text, size_t length);
+
+#endif
@@ -0,0 +1,847 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_client.c
+ *
+ * Overview:
+ * Client core shared by otp_enc and otp_dec.
+ ************************************************************/
+
+#define _GNU_SOURCE    //htobe64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include "otp_cipher.h"
+#include "otp_client.h"
+#include "otp_stream.h"
+#include "otp_pad.h"
+#include "otp_balance.h"
+#include "otp_offline.h"
+
+#define LEGACY_PADDING 100000    //the legacy daemon pads its response to this size
+#define BATCH_WINDOW 64          //messages a batch connection sends ahead of its results
+
+struct batchJob {
+    char *input, *key, *output;
+    const char *message, *keyData;    //mapped while the message is being sent
+    long length;                      //-1 until the message is started
+    long received;
+    int outfd;
+    int failed;
+};
+
+struct batchConnection {
+    int fd;
+    int sendJob, recvJob;     //job being sent and job whose results are arriving
+    long start;               //offset of the segment being sent, -1 before the message starts
+    size_t segment, outLength, outPos;
+    uint32_t header;
+    int terminated;           //the segment being sent is the message's zero length
+    int shut, closed;
+    int endpoint;             //daemon in the endpoint list
+    int reconnects;           //times its messages moved to another daemon
+};
+
+
+/***********************************************************
+ * fatal: prints the client's error statement and exits.
+ *
+ * parameters: client config, what failed.
+ * returns: none.
+ ***********************************************************/
+
+static void fatal(const struct clientConfig *config, const char *what) {
+    fprintf(stderr, "%s: ERROR %s: %s\n", config->name, what, strerror(errno));
+    exit(1);
+}
+
+
+/***********************************************************
+ * mapFile: maps a file read-only so it can be validated and
+ *          sent without copying it through a buffer. text
+ *          files lose their trailing newline.
+ *
+ * parameters: file name, max bytes to map (-1 for all),
+ *             text flag, length out.
+ * returns: start of the mapping, NULL on error.
+ ***********************************************************/
+
+static const char *mapFile(const char *filename, long limit, int text, long *length) {
+    struct stat info;
+    const char *data;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    *length = info.st_size;
+    if (limit >= 0 && *length > limit) {    //only the part we will send
+        *length = limit;
+    }
+    if (*length == 0) {    //nothing to map
+        close(fd);
+        return "";
+    }
+    data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);    //the mapping keeps the file open
+    if (data == MAP_FAILED)
+        return NULL;
+    madvise((void *) data, *length, MADV_SEQUENTIAL);
+
+    if (text && *length == info.st_size && data[*length - 1] == '\n') {    //drop the newline
+        (*length)--;
+    }
+    return data;
+}
+
+
+/***********************************************************
+ * copyResult: copies exactly length result bytes from the
+ *             daemon to stdout.
+ *
+ * parameters: socket, result length, client config.
+ * returns: none.
+ ***********************************************************/
+
+static void copyResult(int sockfd, long length, const struct clientConfig *config) {
+    long received;
+    ssize_t n;
+
+    for (received = 0; received < length; received += n) {
+        n = forwardOutput(sockfd, STDOUT_FILENO, length - received);
+        if (n == 0) {    //daemon rejected the message
+            errno = EPROTO;
+            n = -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            fatal(config, "reading from socket");
+        }
+    }
+}
+
+
+/***********************************************************
+ * sendLegacy: sends message and key to the daemon in one
+ *             writev and copies the result to stdout.
+ *
+ * parameters: socket, message, key, message length, client
+ *             config.
+ * returns: none.
+ ***********************************************************/
+
+static void sendLegacy(int sockfd, const char *message, const char *key, long length, const struct clientConfig *config) {
+    struct iovec iov[4] = {{(void *) message, length}, {"\n", 1}, {(void *) key, length}, {"\n", 1}};
+    ssize_t n;
+
+    if (writeVector(sockfd, iov, 4) < 0)
+        fatal(config, "writing to socket");
+    copyResult(sockfd, length, config);    //the result comes first
+    while ((n = recv(sockfd, NULL, LEGACY_PADDING, MSG_TRUNC)) > 0 || (n < 0 && errno == EINTR))    //discard the padding
+        ;
+}
+
+
+/***********************************************************
+ * sendV2: sends a v2 request (header, message and key in
+ *         one writev, no handshake) and copies the result
+ *         to stdout. packed requests are packed into one
+ *         buffer first and the result unpacked after.
+ *
+ * parameters: socket, message, key, message length, binary
+ *             flag, packed flag, client config.
+ * returns: 0, or -1 if the daemon went away or isn't a v2
+ *          daemon for this operation, before any output.
+ ***********************************************************/
+
+static int sendV2(int sockfd, const char *message, const char *key, long length, int binary, int packed, const struct clientConfig *config) {
+    struct v2Header header;
+    struct iovec iov[3] = {{&header, sizeof(header)}, {(void *) message, length}, {(void *) key, length}};
+    size_t wireLength = PACKED_LENGTH((size_t) length);
+    unsigned char *wire = NULL;
+    char *result;
+
+    if (packed) {
+        wire = malloc(2 * wireLength);
+        if (wire == NULL)
+            fatal(config, "allocating packed buffer");
+        if (packText(wire, message, length) < 0 || packText(wire + wireLength, key, length) < 0) {
+            fprintf(stderr, "%s: ERROR message or key contains invalid characters\n", config->name);
+            exit(1);
+        }
+        iov[1].iov_base = wire;
+        iov[1].iov_len = wireLength;
+        iov[2].iov_base = wire + wireLength;
+        iov[2].iov_len = wireLength;
+    }
+    memcpy(header.magic, V2_MAGIC, sizeof(header.magic));
+    header.version = V2_VERSION;
+    header.code = config->operation;
+    header.flags = htons(binary ? V2_BINARY : packed ? V2_PACKED : 0);
+    header.length = header.keyLength = htonl(length);
+    if (writeVector(sockfd, iov, 3) < 0 || readFull(sockfd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, V2_MAGIC, sizeof(header.magic)) != 0 || header.code == V2_REFUSED) {    //gone, or not a v2 daemon for this operation
+        free(wire);
+        return -1;
+    }
+    if (header.code != V2_OK || ntohl(header.length) != (uint32_t) length ||
+        (packed && !(ntohs(header.flags) & V2_PACKED))) {
+        fprintf(stderr, "%s: ERROR daemon %s the message\n", config->name,
+                header.code == V2_INVALID ? "found invalid characters in" : header.code == V2_BUSY ? "is out of memory for" : "could not take");
+        exit(1);
+    }
+    if (!packed) {
+        copyResult(sockfd, length, config);
+        return 0;
+    }
+
+    result = malloc(length > 0 ? length : 1);    //the mapped message is read-only
+    if (result == NULL)
+        fatal(config, "allocating result");
+    if (readFull(sockfd, wire, wireLength) != (ssize_t) wireLength)
+        fatal(config, "reading from socket");
+    if (unpackText(result, wire, length) < 0) {
+        errno = EPROTO;
+        fatal(config, "unpacking result");
+    }
+    if (writeFull(STDOUT_FILENO, result, length) < 0)
+        fatal(config, "writing result");
+    free(result);
+    free(wire);
+    return 0;
+}
+
+
+/***********************************************************
+ * requestPad: asks the daemon for a range of one of its
+ *             pads to use as the key.
+ *
+ * parameters: socket, pad ID, offset (PAD_ALLOCATE to let
+ *             the daemon pick), message length, client
+ *             config.
+ * returns: offset of the range.
+ ***********************************************************/
+
+static uint64_t requestPad(int sockfd, const char *id, uint64_t offset, long length, const struct clientConfig *config) {
+    struct padRequest request;
+    uint64_t reply;
+
+    memset(&request, '\0', sizeof(request));
+    strncpy(request.id, id, PAD_ID - 1);
+    request.offset = htobe64(offset);
+    request.length = htobe64(length);
+    if (writeFull(sockfd, &request, sizeof(request)) < 0)
+        fatal(config, "writing to socket");
+    if (readFull(sockfd, &reply, sizeof(reply)) != sizeof(reply) || be64toh(reply) == PAD_REFUSED) {
+        fprintf(stderr, "%s: ERROR pad %s has no usable range for this message\n", config->name, id);
+        exit(1);
+    }
+    return be64toh(reply);
+}
+
+
+/***********************************************************
+ * connectDaemon: connects to one daemon, by TCP or Unix
+ *                socket, and makes sure it's the right one.
+ *
+ * parameters: endpoint, handshake suffix picking the
+ *             protocol (NULL for v2, which has no
+ *             handshake), client config.
+ * returns: connected socket, -1 if the daemon can't be
+ *          reached or isn't the right one.
+ ***********************************************************/
+
+static int connectDaemon(const struct balanceEndpoint *endpoint, const char *suffix, const struct clientConfig *config) {
+    int socketFD, n;
+    char auth[32];
+    char response[32];
+
+    socketFD = socket(endpoint->address.ss_family, SOCK_STREAM, 0);    //create the socket
+    if (socketFD < 0)
+        fatal(config, "opening socket");
+    if (connect(socketFD, (const struct sockaddr *) &endpoint->address, endpoint->addressLength) < 0) {    //nobody listening, or no permission
+        close(socketFD);
+        return -1;
+    }
+    if (suffix == NULL)
+        return socketFD;
+
+    snprintf(auth, sizeof(auth), "%s%s", config->handshake, suffix);
+    write(socketFD, auth, strlen(auth) + 1);    //send authority
+    n = read(socketFD, response, sizeof(response) - 1);    //read response
+    response[n > 0 ? n : 0] = '\0';
+    if (strcmp(response, config->response) != 0) {    //make sure it's the correct server
+        close(socketFD);
+        return -1;
+    }
+    return socketFD;
+}
+
+
+/***********************************************************
+ * connectAny: connects to a daemon from the endpoint list,
+ *             moving on to the next pick whenever one can't
+ *             be reached, until each has had a try.
+ *
+ * parameters: balancer, handshake suffix (NULL for v2),
+ *             endpoint index out, client config.
+ * returns: connected socket, -1 if none answered.
+ ***********************************************************/
+
+static int connectAny(struct balancer *balancer, const char *suffix, int *endpoint, const struct clientConfig *config) {
+    int socketFD, attempt;
+
+    for (attempt = 0; attempt < balancer->count; attempt++) {
+        *endpoint = balancePick(balancer);
+        socketFD = connectDaemon(&balancer->endpoints[*endpoint], suffix, config);
+        if (socketFD >= 0) {
+            if (suffix != NULL)    //a v2 daemon only proves itself with its reply
+                balanceHealthy(balancer, *endpoint);
+            return socketFD;
+        }
+        balanceFailed(balancer, *endpoint);
+    }
+    return -1;
+}
+
+
+/***********************************************************
+ * unreachable: reports that no daemon in the list answered.
+ *
+ * parameters: client config.
+ * returns: none, exits.
+ ***********************************************************/
+
+static void unreachable(const struct clientConfig *config) {
+    fprintf(stderr, "Unable to contact %s on given port\n", config->daemon);
+    exit(2);
+}
+
+
+/***********************************************************
+ * readBatchList: reads a batch list, one "input key output"
+ *                line per message. blank lines and lines
+ *                starting with # are skipped.
+ *
+ * parameters: list file name, job count out, client config.
+ * returns: job array.
+ ***********************************************************/
+
+static struct batchJob *readBatchList(const char *filename, int *count, const struct clientConfig *config) {
+    FILE *list = fopen(filename, "r");
+    struct batchJob *jobs = NULL, *grown;
+    char *line = NULL, *input, *key, *output;
+    size_t lineSize = 0;
+    int capacity = 0;
+
+    if (list == NULL)
+        fatal(config, "opening batch list");
+    *count = 0;
+    while (getline(&line, &lineSize, list) > 0) {
+        input = strtok(line, " \t\n");
+        if (input == NULL || input[0] == '#')
+            continue;
+        key = strtok(NULL, " \t\n");
+        output = strtok(NULL, " \t\n");
+        if (key == NULL || output == NULL) {
+            fprintf(stderr, "%s: ERROR batch line for %s needs input, key and output\n", config->name, input);
+            exit(1);
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            grown = realloc(jobs, capacity * sizeof(*jobs));
+            if (grown == NULL)
+                fatal(config, "reading batch list");
+            jobs = grown;
+        }
+        memset(&jobs[*count], '\0', sizeof(*jobs));
+        jobs[*count].input = strdup(input);
+        jobs[*count].key = strdup(key);
+        jobs[*count].output = strdup(output);
+        jobs[*count].length = -1;    //not started
+        jobs[*count].outfd = -1;
+        (*count)++;
+    }
+    free(line);
+    fclose(list);
+    return jobs;
+}
+
+
+/***********************************************************
+ * failJob: reports a message that could not be done.
+ *
+ * parameters: job, reason, client config.
+ * returns: none.
+ ***********************************************************/
+
+static void failJob(struct batchJob *job, const char *what, const struct clientConfig *config) {
+    fprintf(stderr, "%s: ERROR %s %s: %s\n", config->name, what, job->input, strerror(errno));
+    job->failed = 1;
+    if (job->outfd >= 0) {
+        close(job->outfd);
+        job->outfd = -1;
+    }
+}
+
+
+/***********************************************************
+ * startJob: maps a message and its key and opens its output
+ *           so the connection can start sending it. a job
+ *           that can't be sent is marked failed and skipped.
+ *
+ * parameters: job, binary flag, client config.
+ * returns: 0 if the job is ready to send, -1 if it failed.
+ ***********************************************************/
+
+static int startJob(struct batchJob *job, int binary, const struct clientConfig *config) {
+    long keyLength;
+
+    job->message = mapFile(job->input, -1, !binary, &job->length);
+    if (job->message == NULL) {
+        failJob(job, "opening", config);
+        return -1;
+    }
+    job->keyData = mapFile(job->key, job->length, 0, &keyLength);
+    if (job->keyData == NULL || keyLength < job->length) {    //check that key is at least as long as message
+        errno = job->keyData == NULL ? errno : EINVAL;
+        failJob(job, "key too short or unreadable for", config);
+        return -1;
+    }
+    if (config->validate && !binary && !cipherValid(&textAlphabet, job->message, job->length)) {
+        errno = EINVAL;
+        failJob(job, "invalid characters in", config);
+        return -1;
+    }
+    job->outfd = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job->outfd < 0) {
+        failJob(job, "opening output for", config);
+        return -1;
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * finishSend: releases a message and key once every byte of
+ *             them is on the wire.
+ *
+ * parameters: job.
+ * returns: none.
+ ***********************************************************/
+
+static void finishSend(struct batchJob *job) {
+    if (job->length > 0) {
+        munmap((void *) job->message, job->length);
+        munmap((void *) job->keyData, job->length);
+    }
+    job->message = job->keyData = NULL;
+}
+
+
+/***********************************************************
+ * queueSegment: moves a batch connection on to its next
+ *               segment, message or, after the last one, the
+ *               end of its requests.
+ *
+ * parameters: connection, jobs, job count, stride between
+ *             this connection's jobs, binary flag, client
+ *             config.
+ * returns: none.
+ ***********************************************************/
+
+static void queueSegment(struct batchConnection *bc, struct batchJob *jobs, int count, int stride, int binary,
+                         const struct clientConfig *config) {
+    struct batchJob *job;
+
+    while (bc->outPos == bc->outLength && bc->sendJob < count) {
+        job = &jobs[bc->sendJob];
+        if (bc->terminated) {    //that was the zero length, the message is done
+            finishSend(job);
+            bc->sendJob += stride;
+            bc->terminated = 0;
+            bc->segment = 0;
+            bc->start = -1;
+            continue;
+        }
+        if (bc->start < 0) {    //new message
+            if (job->failed) {    //already reported, when its connection was replaced
+                bc->sendJob += stride;
+                continue;
+            }
+            if (bc->sendJob - bc->recvJob >= BATCH_WINDOW * stride) {    //enough in flight, wait for results
+                return;
+            }
+            if (startJob(job, binary, config) < 0) {
+                job->length = -1;    //never sent, no results to wait for
+                bc->sendJob += stride;
+                continue;
+            }
+            bc->start = 0;
+        } else {
+            bc->start += bc->segment;
+        }
+        bc->segment = job->length - bc->start < STREAM_SEGMENT ? job->length - bc->start : STREAM_SEGMENT;
+        bc->header = htonl(bc->segment);
+        bc->outLength = sizeof(bc->header) + 2 * bc->segment;
+        bc->outPos = 0;
+        bc->terminated = (bc->segment == 0);
+    }
+    if (bc->outPos == bc->outLength && bc->sendJob >= count && !bc->shut) {    //nothing left to ask for
+        shutdown(bc->fd, SHUT_WR);
+        bc->shut = 1;
+    }
+}
+
+
+/***********************************************************
+ * receiveResults: writes result bytes that have arrived to
+ *                 the outputs of the messages they belong
+ *                 to, in the order the messages were sent.
+ *
+ * parameters: connection, jobs, job count, stride, binary
+ *             flag, client config.
+ * returns: 0 on success, -1 when the connection is over.
+ ***********************************************************/
+
+static int receiveResults(struct batchConnection *bc, struct batchJob *jobs, int count, int stride, int binary,
+                          const struct clientConfig *config) {
+    static char buffer[STREAM_SEGMENT];
+    struct batchJob *job;
+    ssize_t n;
+
+    while (1) {
+        while (bc->recvJob < bc->sendJob + (bc->start >= 0 ? stride : 0) && bc->recvJob < count) {    //close out finished ones
+            job = &jobs[bc->recvJob];
+            if (job->received < job->length) {    //failed or not, the rest of its result is still coming
+                break;
+            }
+            if (!job->failed) {
+                if ((!binary && writeFull(job->outfd, "\n", 1) < 0) || close(job->outfd) < 0) {
+                    job->outfd = -1;
+                    failJob(job, "writing output for", config);
+                }
+                job->outfd = -1;
+            }
+            bc->recvJob += stride;
+        }
+
+        job = bc->recvJob < count ? &jobs[bc->recvJob] : NULL;
+        n = read(bc->fd, buffer, job != NULL && job->length > job->received && job->length - job->received < (long) sizeof(buffer)
+                                 ? (size_t) (job->length - job->received) : sizeof(buffer));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                return 0;
+            return -1;
+        }
+        if (n == 0) {    //daemon closed, done or not
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (job == NULL || job->length < 0 || job->received + n > job->length) {    //more than we asked for
+            errno = EPROTO;
+            return -1;
+        }
+        if (!job->failed && writeFull(job->outfd, buffer, n) < 0) {    //a failed job's bytes are read and dropped
+            failJob(job, "writing output for", config);
+        }
+        job->received += n;
+    }
+}
+
+
+/***********************************************************
+ * moveConnection: replaces a batch connection whose daemon
+ *                 went away with one to another daemon, and
+ *                 starts over every message it hadn't
+ *                 finished, except those that already failed.
+ *                 results are the same whichever daemon makes
+ *                 them, so outputs are simply rewritten.
+ *
+ * parameters: connection, balancer, jobs, job count,
+ *             stride, binary flag, client config.
+ * returns: 0 on success, -1 if no other daemon answered.
+ ***********************************************************/
+
+static int moveConnection(struct batchConnection *bc, struct balancer *balancer, struct batchJob *jobs, int count,
+                          int stride, int binary, const struct clientConfig *config) {
+    struct batchJob *job;
+    int j;
+
+    close(bc->fd);
+    bc->fd = -1;
+    balancer->endpoints[bc->endpoint].outstanding--;
+    balanceFailed(balancer, bc->endpoint);
+    if (bc->reconnects++ == balancer->count)    //every daemon has had a turn
+        return -1;
+    bc->fd = connectAny(balancer, binary ? "_batch_bytes" : "_batch", &bc->endpoint, config);
+    if (bc->fd < 0)
+        return -1;
+    fcntl(bc->fd, F_SETFL, fcntl(bc->fd, F_GETFL) | O_NONBLOCK);
+    balancer->endpoints[bc->endpoint].outstanding++;
+
+    for (j = bc->recvJob; j < count && j <= bc->sendJob; j += stride) {    //in flight on the old connection
+        job = &jobs[j];
+        if (job->length < 0)
+            continue;
+        if (job->message != NULL)
+            finishSend(job);
+        if (job->failed) {    //not sent again, and nothing more comes for it
+            job->length = -1;
+            continue;
+        }
+        if (job->outfd >= 0)
+            close(job->outfd);
+        job->outfd = -1;
+        job->length = -1;
+        job->received = 0;
+    }
+    bc->sendJob = bc->recvJob;
+    bc->start = -1;
+    bc->segment = bc->outLength = bc->outPos = 0;
+    bc->terminated = bc->shut = 0;
+    queueSegment(bc, jobs, count, stride, binary, config);
+    return 0;
+}
+
+
+/***********************************************************
+ * runBatch: transforms every message in a batch list over a
+ *           few persistent connections, spread over the
+ *           daemons in the endpoint list. each connection
+ *           takes every nth message and pipelines them: it
+ *           keeps sending while the results of earlier ones
+ *           stream back into their own output files.
+ *
+ * parameters: batch list, number of connections, binary
+ *             flag, endpoint list, client config.
+ * returns: exit status.
+ ***********************************************************/
+
+static int runBatch(const char *listFile, int connections, int binary, struct balancer *balancer, const struct clientConfig *config) {
+    struct batchConnection *bcs;
+    struct batchJob *jobs;
+    struct pollfd *pfds;
+    struct iovec iov[3];
+    int count, live, i, j, status = 0;
+    ssize_t n;
+
+    jobs = readBatchList(listFile, &count, config);
+    if (connections > count)
+        connections = count > 0 ? count : 1;
+    bcs = calloc(connections, sizeof(*bcs));
+    pfds = calloc(connections, sizeof(*pfds));
+    if (bcs == NULL || pfds == NULL)
+        fatal(config, "allocating connections");
+
+    signal(SIGPIPE, SIG_IGN);    //a daemon dropping a connection moves its messages, it doesn't kill the client
+    for (i = 0; i < connections; i++) {
+        bcs[i].fd = connectAny(balancer, binary ? "_batch_bytes" : "_batch", &bcs[i].endpoint, config);    //least loaded of two daemons
+        if (bcs[i].fd < 0)
+            unreachable(config);
+        balancer->endpoints[bcs[i].endpoint].outstanding++;
+        fcntl(bcs[i].fd, F_SETFL, fcntl(bcs[i].fd, F_GETFL) | O_NONBLOCK);
+        bcs[i].sendJob = bcs[i].recvJob = i;
+        bcs[i].start = -1;
+        queueSegment(&bcs[i], jobs, count, connections, binary, config);
+    }
+
+    for (live = connections; live > 0; ) {
+        for (i = 0; i < connections; i++) {
+            pfds[i].fd = bcs[i].closed ? -1 : bcs[i].fd;
+            pfds[i].events = POLLIN | (bcs[i].outPos < bcs[i].outLength ? POLLOUT : 0);
+        }
+        if (poll(pfds, connections, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fatal(config, "waiting on connections");
+        }
+        for (i = 0; i < connections; i++) {
+            struct batchConnection *bc = &bcs[i];
+            if (bc->closed)
+                continue;
+            if (pfds[i].revents & POLLOUT) {
+                n = writev(bc->fd, iov, segmentVector(iov, &bc->header, jobs[bc->sendJob].message + bc->start,
+                                                      jobs[bc->sendJob].keyData + bc->start, bc->segment, bc->outPos));
+                if (n > 0)
+                    bc->outPos += n;
+            }
+            if ((pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                receiveResults(bc, jobs, count, connections, binary, config) < 0) {
+                if (bc->recvJob < count && moveConnection(bc, balancer, jobs, count, connections, binary, config) == 0)
+                    continue;
+                for (j = bc->recvJob; j < count; j += connections) {    //whatever is left on this connection is lost
+                    if (!jobs[j].failed && (jobs[j].length < 0 || jobs[j].received < jobs[j].length)) {
+                        failJob(&jobs[j], "daemon dropped", config);
+                    }
+                }
+                close(bc->fd);
+                bc->closed = 1;
+                live--;
+                continue;
+            }
+            queueSegment(bc, jobs, count, connections, binary, config);
+        }
+    }
+
+    for (j = 0; j < count; j++) {
+        status |= jobs[j].failed;
+    }
+    return status;
+}
+
+
+/***********************************************************
+ * clientMain: parses the client's arguments, contacts the
+ *             daemon and prints the transformed file.
+ *
+ * parameters: number of arguments, argument array, client
+ *             config.
+ * returns: exit status.
+ ***********************************************************/
+
+int clientMain(int argc, char *argv[], const struct clientConfig *config) {
+    struct balancer *balancer;
+    int socketFD, endpoint, attempt;
+    long messageLength, keyLength;
+    uint64_t padOffset = PAD_ALLOCATE;
+
+    int opt, stream = 0, binary = 0, legacy = 0, packed = 0;
+    char *padId = NULL, *colon, *batchList = NULL, *offlinePad = NULL;
+    int connections = 1, threads = sysconf(_SC_NPROCESSORS_ONLN), usage;
+    while ((opt = getopt(argc, argv, "slbzp:B:c:O:t:")) != -1) {
+        if (opt == 's') {
+            stream = 1;    //stream segments instead of whole files
+        } else if (opt == 'l') {
+            legacy = 1;    //newline-delimited text protocol, for older daemons
+        } else if (opt == 'b') {
+            binary = 1;    //raw bytes, XOR with the key
+        } else if (opt == 'z') {
+            packed = 1;    //pack text five symbols to three bytes on the wire
+        } else if (opt == 'p') {
+            stream = 1;    //key comes from the daemon's pad, message is streamed
+            padId = optarg;
+            if ((colon = strchr(padId, ':')) != NULL) {    //pad:offset picks the range
+                *colon = '\0';
+                padOffset = strtoull(colon + 1, NULL, 10);
+            }
+        } else if (opt == 'B') {
+            batchList = optarg;    //many messages over persistent connections
+        } else if (opt == 'c' && atoi(optarg) > 0) {
+            connections = atoi(optarg);    //connections to spread a batch over
+        } else if (opt == 'O') {
+            offlinePad = optarg;    //transform in this process, keys from a pad file
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            threads = atoi(optarg);    //threads for offline mode, including this one
+        } else {
+            optind = argc;    //force the usage message
+            break;
+        }
+    }
+    if (offlinePad != NULL)    //no daemon, so none of the protocol options apply
+        usage = argc - optind < 2 || stream || legacy || packed || padId != NULL || batchList != NULL;
+    else
+        usage = argc - optind != (batchList != NULL ? 1 : padId != NULL ? 2 : 3) || (batchList != NULL && padId != NULL) ||
+                (packed && (stream || legacy || binary || batchList != NULL));    //packing is a v2 text option
+    if (usage) {
+        fprintf(stderr, "Usage: %s [-s|-l] [-b] <inputfile> <key> <endpoints>\n"
+                        "       %s -z <inputfile> <key> <endpoints>\n"
+                        "       %s [-b] -p pad[:offset] <inputfile> <endpoints>\n"
+                        "       %s [-b] -B <list> [-c connections] <endpoints>\n"
+                        "       %s [-b] -O padfile[:offset] [-t threads] <input>... <outputdir>\n"
+                        "endpoints: port, host:port or socket path, or several separated by commas\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0]);    //check usage & args
+        exit(1);
+    }
+    if (offlinePad != NULL)
+        return runOffline(offlinePad, argv + optind, argc - optind - 1, argv[argc - 1], threads, binary, config);
+    balancer = balanceOpen(argv[argc - 1]);
+    if (balancer == NULL)
+        fatal(config, "reading endpoints");
+    if (batchList != NULL)
+        return runBatch(batchList, connections, binary, balancer, config);
+
+    char *inputFile = argv[optind];
+    char *keyFile = padId != NULL ? NULL : argv[optind + 1];
+
+    const char *message = mapFile(inputFile, -1, !binary, &messageLength);
+    const char *key = NULL;
+    if (message == NULL)
+        fatal(config, "opening file");
+    if (keyFile != NULL && (key = mapFile(keyFile, messageLength, 0, &keyLength)) == NULL)
+        fatal(config, "opening file");
+    if (keyFile != NULL && keyLength < messageLength) {    //check that key is at least as long as message
+        fprintf(stderr, "Key is too short\n");
+        exit(1);
+    }
+    if (legacy && binary)    //the text protocol can't carry binary data
+        stream = 1;
+    if (!legacy && messageLength > V2_MAX_LENGTH)    //too big to hold in the daemon at once
+        stream = 1;
+    if (config->validate && !stream && !binary && !cipherValid(&textAlphabet, message, messageLength)) {    //one pass over the mapping
+        fprintf(stderr, "%s contains invalid characters\n", inputFile);
+        exit(1);
+    }
+
+    if (packed && cipherSelect(NULL) == NULL)    //vector packers, picked the way the daemons pick kernels
+        fatal(config, "selecting cipher kernel");
+
+    if (padId != NULL)
+        socketFD = connectAny(balancer, binary ? "_pad_bytes" : "_pad", &endpoint, config);
+    else if (stream)
+        socketFD = connectAny(balancer, binary ? "_stream_bytes" : "_stream", &endpoint, config);
+    else if (legacy)
+        socketFD = connectAny(balancer, "", &endpoint, config);
+    else {    //v2 sends its request in the first flight, so a daemon only fails it once it's sent
+        for (attempt = 0; attempt < balancer->count; attempt++) {
+            socketFD = connectAny(balancer, NULL, &endpoint, config);
+            if (socketFD < 0 || sendV2(socketFD, message, key, messageLength, binary, packed, config) == 0)
+                break;
+            close(socketFD);
+            socketFD = -1;
+            balanceFailed(balancer, endpoint);
+        }
+    }
+    if (socketFD < 0)
+        unreachable(config);
+
+    if (padId != NULL) {
+        uint64_t start = requestPad(socketFD, padId, padOffset, messageLength, config);
+        if (padOffset == PAD_ALLOCATE)    //needed to decrypt later
+            fprintf(stderr, "pad %s:%llu\n", padId, (unsigned long long) start);
+    }
+
+    if (stream) {    //send and receive one segment at a time
+        int result = sendStream(socketFD, message, key, messageLength, config->validate && !binary ? &textAlphabet : NULL, STDOUT_FILENO);
+        if (result == -2) {    //validated segment by segment on the way out
+            fprintf(stderr, "%s contains invalid characters\n", inputFile);
+            exit(1);
+        }
+        if (result < 0)
+            fatal(config, "streaming message");
+    } else if (legacy) {
+        sendLegacy(socketFD, message, key, messageLength, config);
+    }
+    if (!binary)
+        writeFull(STDOUT_FILENO, "\n", 1);
+    close(socketFD);    //close the socket
+    return 0;
+}
@@ -0,0 +1,26 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_client.h
+ *
+ * Overview:
+ * Client core shared by otp_enc and otp_dec, which differ
+ * only in the handshake they send and whether they check
+ * the input before sending it.
+ ************************************************************/
+
+#ifndef OTP_CLIENT_H
+#define OTP_CLIENT_H
+
+struct clientConfig {
+    const char *name;         //prefix for error messages, e.g. "Encrypt Client"
+    const char *daemon;       //daemon to name when the handshake fails
+    const char *handshake;    //legacy handshake, e.g. "enc_bs"
+    const char *response;     //expected confirmation, e.g. "enc_d_bs"
+    int validate;             //check the input for invalid chars before sending
+    int operation;            //V2_ENCRYPT or V2_DECRYPT
+};
+
+int clientMain(int argc, char *argv[], const struct clientConfig *config);
+
+#endif
@@ -0,0 +1,28 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_d.c
+ *
+ * Overview:
+ * This is the combined daemon. It answers both the otp_enc
+ * and otp_dec handshakes on one port, so both directions
+ * share one listener and one pool of workers.
+ ************************************************************/
+
+#include "otp_server.h"
+
+
+/***********************************************************
+ * main: runs the combined daemon.
+ *
+ * parameters: number of arguments, argument array.
+ * returns: exit status.
+ ***********************************************************/
+
+int main(int argc, char *argv[]) {
+    static const struct serverConfig config = {
+        "Cipher Server", cipherServices, 2
+    };
+
+    return serverMain(argc, argv, &config);
+}
@@ -0,0 +1,133 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_hist.c
+ *
+ * Overview:
+ * Log-linear latency histogram for the benchmark tools.
+ ************************************************************/
+
+#include <string.h>
+#include "otp_hist.h"
+
+#define HIST_LINEAR 64    //values below this get a bucket each
+#define HIST_SUB 32       //buckets per power of two above that
+
+
+/***********************************************************
+ * bucketOf: finds the bucket a value falls in.
+ *
+ * parameters: value.
+ * returns: bucket index.
+ ***********************************************************/
+
+static int bucketOf(uint64_t value) {
+    int shift;
+
+    if (value < HIST_LINEAR) {
+        return value;
+    }
+    shift = 63 - __builtin_clzll(value) - 5;    //keeps the top 6 bits, 32..63
+    if (HIST_LINEAR + (shift - 1) * HIST_SUB + (int) (value >> shift) - HIST_SUB >= HIST_BUCKETS) {
+        return HIST_BUCKETS - 1;
+    }
+    return HIST_LINEAR + (shift - 1) * HIST_SUB + (value >> shift) - HIST_SUB;
+}
+
+
+/***********************************************************
+ * bucketValue: highest value a bucket holds.
+ *
+ * parameters: bucket index.
+ * returns: value.
+ ***********************************************************/
+
+static uint64_t bucketValue(int bucket) {
+    int shift;
+
+    if (bucket < HIST_LINEAR) {
+        return bucket;
+    }
+    shift = (bucket - HIST_LINEAR) / HIST_SUB + 1;
+    return ((uint64_t) ((bucket - HIST_LINEAR) % HIST_SUB + HIST_SUB + 1) << shift) - 1;
+}
+
+
+/***********************************************************
+ * histInit: empties a histogram.
+ *
+ * parameters: histogram.
+ * returns: none.
+ ***********************************************************/
+
+void histInit(struct histogram *hist) {
+    memset(hist, '\0', sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+
+/***********************************************************
+ * histRecord: adds one value.
+ *
+ * parameters: histogram, value.
+ * returns: none.
+ ***********************************************************/
+
+void histRecord(struct histogram *hist, uint64_t value) {
+    hist->counts[bucketOf(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+
+/***********************************************************
+ * histMerge: adds every value of one histogram to another.
+ *
+ * parameters: histogram to add to, histogram to add.
+ * returns: none.
+ ***********************************************************/
+
+void histMerge(struct histogram *into, const struct histogram *from) {
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    into->sum += from->sum;
+    if (from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+
+/***********************************************************
+ * histPercentile: value at or below which the given share
+ *                 of the recorded values fall.
+ *
+ * parameters: histogram, percentile (0 to 100).
+ * returns: value, 0 if nothing was recorded.
+ ***********************************************************/
+
+uint64_t histPercentile(const struct histogram *hist, double percentile) {
+    uint64_t rank, seen = 0;
+    int i;
+
+    if (hist->total == 0) {
+        return 0;
+    }
+    rank = (uint64_t) (percentile / 100.0 * hist->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            return bucketValue(i) < hist->max ? bucketValue(i) : hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,33 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_hist.h
+ *
+ * Overview:
+ * Log-linear latency histogram for the benchmark tools, in
+ * the style of HdrHistogram: every power of two is split
+ * into 32 equal buckets, so any recorded value is off by at
+ * most about 3% while the whole range from a nanosecond to
+ * hours fits in a few kilobytes.
+ ************************************************************/
+
+#ifndef OTP_HIST_H
+#define OTP_HIST_H
+
+#include <stdint.h>
+
+#define HIST_BUCKETS 2048
+
+struct histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min, max;
+    double sum;
+};
+
+void histInit(struct histogram *hist);
+void histRecord(struct histogram *hist, uint64_t value);
+void histMerge(struct histogram *into, const struct histogram *from);
+uint64_t histPercentile(const struct histogram *hist, double percentile);
+
+#endif
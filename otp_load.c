@@ -0,0 +1,594 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_load.c
+ *
+ * Overview:
+ * Load generator for the daemons. Drives many concurrent v2
+ * requests from one event loop, either closed loop (each
+ * client starts its next request when the last one ends) or
+ * open loop (requests arrive at a fixed average rate no
+ * matter how the daemon keeps up). Every result is checked:
+ * against a local encryption, or by decrypting it on a
+ * second daemon and comparing with the original. Prints a
+ * single JSON object with throughput, errors and latency
+ * percentiles.
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "otp_cipher.h"
+#include "otp_stream.h"
+#include "otp_hist.h"
+
+#define LOAD_EVENTS 256
+#define LOAD_CORPUS_MAX 16
+
+#define SIZE_CORPUS 0     //sizes of the corpus files themselves
+#define SIZE_FIXED 1
+#define SIZE_UNIFORM 2
+
+#define STAGE_ENCRYPT 0
+#define STAGE_DECRYPT 1
+
+#define ERROR_IO 0          //couldn't connect, or the daemon hung up
+#define ERROR_STATUS 1      //daemon answered with an error status
+#define ERROR_MISMATCH 2    //result was wrong
+#define ERROR_KINDS 3
+
+struct loadConfig {
+    struct sockaddr_storage encrypt, decrypt;    //loopback TCP or Unix socket
+    socklen_t encryptLength, decryptLength;
+    int checkByDecrypt;       //round trip through a decrypting daemon
+    int concurrency;
+    double rate;              //open loop arrivals per second, 0 for closed loop
+    double duration;          //seconds, 0 to stop after requests
+    long requests;
+    int sizeMode;
+    long sizeMin, sizeMax;
+    const char *label;
+    int packed;               //V2_PACKED requests
+};
+
+struct loadClient {
+    int fd;
+    int busy, stage;
+    double start;             //when the request was due, for latency
+    long length;
+    size_t messageAt, keyAt;  //offsets into the corpus and key pool
+    char *request;            //header, message and key
+    size_t requestLength, sent;
+    char *reply;              //header and result
+    size_t replyLength, received;
+    char *expected;           //what the result has to be
+};
+
+static char *corpus;          //every corpus file back to back, newlines removed
+static size_t corpusLength;
+static long corpusSizes[LOAD_CORPUS_MAX];
+static int corpusCount;
+static char *keyPool;
+static size_t keyPoolLength;
+
+static double *dueTimes;      //open loop arrivals still waiting for a free client
+static long dueHead, dueTail, dueCapacity;
+
+static struct histogram latency;
+static long completed, errors[ERROR_KINDS];
+static unsigned long long bytesMoved;
+
+
+/***********************************************************
+ * now: monotonic time.
+ *
+ * parameters: none.
+ * returns: seconds.
+ ***********************************************************/
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/***********************************************************
+ * loadCorpus: reads the sample messages every request is
+ *             cut from.
+ *
+ * parameters: file name.
+ * returns: none.
+ ***********************************************************/
+
+static void loadCorpus(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    long length;
+    char *grown;
+
+    if (file == NULL || corpusCount == LOAD_CORPUS_MAX) {
+        fprintf(stderr, "otp_load: ERROR reading corpus %s\n", filename);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    rewind(file);
+    grown = realloc(corpus, corpusLength + length + 1);
+    if (grown == NULL || fread(grown + corpusLength, 1, length, file) != (size_t) length) {
+        fprintf(stderr, "otp_load: ERROR reading corpus %s\n", filename);
+        exit(1);
+    }
+    corpus = grown;
+    if (length > 0 && corpus[corpusLength + length - 1] == '\n')    //drop the newline
+        length--;
+    corpusSizes[corpusCount++] = length;
+    corpusLength += length;
+    fclose(file);
+}
+
+
+/***********************************************************
+ * pickSize: draws a message size from the configured
+ *           distribution.
+ *
+ * parameters: load config.
+ * returns: message length.
+ ***********************************************************/
+
+static long pickSize(const struct loadConfig *config) {
+    if (config->sizeMode == SIZE_FIXED)
+        return config->sizeMin;
+    if (config->sizeMode == SIZE_UNIFORM)
+        return config->sizeMin + random() % (config->sizeMax - config->sizeMin + 1);
+    return corpusSizes[random() % corpusCount];
+}
+
+
+/***********************************************************
+ * corpusCopy: copies length bytes of the corpus, starting
+ *             anywhere and wrapping around at the end.
+ *
+ * parameters: destination, start offset, length.
+ * returns: none.
+ ***********************************************************/
+
+static void corpusCopy(char *dest, size_t at, size_t length) {
+    size_t chunk;
+
+    while (length > 0) {
+        at %= corpusLength;
+        chunk = corpusLength - at < length ? corpusLength - at : length;
+        memcpy(dest, corpus + at, chunk);
+        dest += chunk;
+        at += chunk;
+        length -= chunk;
+    }
+}
+
+
+/***********************************************************
+ * buildRequest: lays out a v2 request for one stage of the
+ *               client's message.
+ *
+ * parameters: client, stage, message bytes for the stage,
+ *             load config.
+ * returns: 0 on success, -1 if out of memory.
+ ***********************************************************/
+
+static int buildRequest(struct loadClient *client, int stage, const char *message, const struct loadConfig *config) {
+    struct v2Header *header;
+    size_t length = client->length;
+    size_t wireLength = config->packed ? PACKED_LENGTH(length) : length;
+
+    client->requestLength = sizeof(*header) + 2 * wireLength;
+    client->request = realloc(client->request, client->requestLength);
+    if (client->request == NULL)
+        return -1;
+
+    header = (struct v2Header *) client->request;
+    memcpy(header->magic, V2_MAGIC, sizeof(header->magic));
+    header->version = V2_VERSION;
+    header->code = stage == STAGE_ENCRYPT ? V2_ENCRYPT : V2_DECRYPT;
+    header->flags = htons(config->packed ? V2_PACKED : 0);
+    header->length = header->keyLength = htonl(length);
+    if (config->packed) {    //message may be the last reply, so pack before resizing it
+        packText((unsigned char *) client->request + sizeof(*header), message, length);
+        packText((unsigned char *) client->request + sizeof(*header) + wireLength, keyPool + client->keyAt, length);
+    } else {
+        memcpy(client->request + sizeof(*header), message, length);    //may be the last reply, so copy before resizing it
+        memcpy(client->request + sizeof(*header) + length, keyPool + client->keyAt, length);
+    }
+
+    client->replyLength = sizeof(*header) + wireLength;
+    client->reply = realloc(client->reply, client->replyLength + (config->packed ? length : 0));    //room to unpack into
+    if (client->reply == NULL)
+        return -1;
+    client->sent = client->received = 0;
+    client->stage = stage;
+    return 0;
+}
+
+
+/***********************************************************
+ * openRequest: connects to the daemon for the client's
+ *              current stage and registers the socket.
+ *
+ * parameters: epoll fd, client, load config.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+static int openRequest(int epollFD, struct loadClient *client, const struct loadConfig *config) {
+    const struct sockaddr_storage *address = client->stage == STAGE_ENCRYPT ? &config->encrypt : &config->decrypt;
+    socklen_t length = client->stage == STAGE_ENCRYPT ? config->encryptLength : config->decryptLength;
+    struct epoll_event event;
+
+    client->fd = socket(address->ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (client->fd < 0)
+        return -1;
+    if (connect(client->fd, (const struct sockaddr *) address, length) < 0 && errno != EINPROGRESS)
+        return -1;
+    event.events = EPOLLOUT | EPOLLIN;
+    event.data.ptr = client;
+    return epoll_ctl(epollFD, EPOLL_CTL_ADD, client->fd, &event);
+}
+
+
+static void finishRequest(struct loadClient *client, int error);
+
+
+/***********************************************************
+ * startRequest: begins a new message on an idle client.
+ *
+ * parameters: epoll fd, client, when it was due, load
+ *             config.
+ * returns: none.
+ ***********************************************************/
+
+static void startRequest(int epollFD, struct loadClient *client, double due, const struct loadConfig *config) {
+    client->busy = 1;
+    client->start = due;
+    client->length = pickSize(config);
+    client->messageAt = random() % corpusLength;
+    client->keyAt = random() % (keyPoolLength - client->length + 1);
+    client->expected = realloc(client->expected, client->length > 0 ? client->length : 1);
+    if (client->expected == NULL) {
+        finishRequest(client, ERROR_IO);
+        return;
+    }
+    corpusCopy(client->expected, client->messageAt, client->length);
+    if (buildRequest(client, STAGE_ENCRYPT, client->expected, config) < 0) {
+        finishRequest(client, ERROR_IO);
+        return;
+    }
+    if (!config->checkByDecrypt)    //the result has to match our own encryption
+        encryptMessage(client->expected, keyPool + client->keyAt, client->length);
+    if (openRequest(epollFD, client, config) < 0)
+        finishRequest(client, ERROR_IO);
+}
+
+
+/***********************************************************
+ * finishRequest: records a message as done, or failed, and
+ *                frees the client.
+ *
+ * parameters: client, error kind (-1 for none).
+ * returns: none.
+ ***********************************************************/
+
+static void finishRequest(struct loadClient *client, int error) {
+    if (client->fd >= 0) {
+        close(client->fd);    //also leaves the epoll set
+        client->fd = -1;
+    }
+    if (error >= 0) {
+        errors[error]++;
+    } else {
+        histRecord(&latency, (uint64_t) ((now() - client->start) * 1e9));
+        bytesMoved += client->length;
+    }
+    completed++;
+    client->busy = 0;
+}
+
+
+/***********************************************************
+ * checkReply: looks at a complete reply and either moves the
+ *             message on to its decrypt stage or finishes it.
+ *
+ * parameters: epoll fd, client, load config.
+ * returns: none.
+ ***********************************************************/
+
+static void checkReply(int epollFD, struct loadClient *client, const struct loadConfig *config) {
+    struct v2Header *header = (struct v2Header *) client->reply;
+    char *result = client->reply + sizeof(*header);
+
+    if (memcmp(header->magic, V2_MAGIC, sizeof(header->magic)) != 0 || header->code != V2_OK) {
+        finishRequest(client, ERROR_STATUS);
+        return;
+    }
+    if (config->packed) {    //unpack after the packed bytes
+        result = client->reply + client->replyLength;
+        if (unpackText(result, (const unsigned char *) client->reply + sizeof(*header), client->length) < 0) {
+            finishRequest(client, ERROR_MISMATCH);
+            return;
+        }
+    }
+    if (client->stage == STAGE_ENCRYPT && config->checkByDecrypt) {    //send the ciphertext back the other way
+        close(client->fd);
+        client->fd = -1;
+        if (buildRequest(client, STAGE_DECRYPT, result, config) < 0 || openRequest(epollFD, client, config) < 0)
+            finishRequest(client, ERROR_IO);
+        return;
+    }
+    finishRequest(client, memcmp(result, client->expected, client->length) == 0 ? -1 : ERROR_MISMATCH);
+}
+
+
+/***********************************************************
+ * pumpClient: sends what it can of the request and reads
+ *             what has arrived of the reply.
+ *
+ * parameters: epoll fd, client, load config.
+ * returns: none.
+ ***********************************************************/
+
+static void pumpClient(int epollFD, struct loadClient *client, const struct loadConfig *config) {
+    struct epoll_event event;
+    ssize_t n;
+
+    if (!client->busy)    //finished earlier in this round
+        return;
+
+    while (client->sent < client->requestLength) {
+        n = write(client->fd, client->request + client->sent, client->requestLength - client->sent);
+        if (n < 0) {
+            if (errno == EAGAIN)
+                return;
+            if (errno == EINTR)
+                continue;
+            finishRequest(client, ERROR_IO);
+            return;
+        }
+        client->sent += n;
+        if (client->sent == client->requestLength) {    //only the reply left to wait for
+            event.events = EPOLLIN;
+            event.data.ptr = client;
+            epoll_ctl(epollFD, EPOLL_CTL_MOD, client->fd, &event);
+        }
+    }
+    while (client->received < client->replyLength) {
+        n = read(client->fd, client->reply + client->received, client->replyLength - client->received);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            if (errno == EAGAIN)
+                return;
+            continue;
+        }
+        if (n <= 0) {    //error replies are shorter than a full one
+            finishRequest(client, client->received >= sizeof(struct v2Header) ? ERROR_STATUS : ERROR_IO);
+            return;
+        }
+        client->received += n;
+        if (client->received >= sizeof(struct v2Header) && ((struct v2Header *) client->reply)->code != V2_OK) {
+            finishRequest(client, ERROR_STATUS);
+            return;
+        }
+    }
+    checkReply(epollFD, client, config);
+}
+
+
+/***********************************************************
+ * queueArrival: remembers when an open loop request was due
+ *               until a client is free to send it.
+ *
+ * parameters: due time.
+ * returns: none.
+ ***********************************************************/
+
+static void queueArrival(double due) {
+    double *grown;
+
+    if (dueTail == dueCapacity) {
+        if (dueHead > 0) {    //slide the waiting ones to the front
+            memmove(dueTimes, dueTimes + dueHead, (dueTail - dueHead) * sizeof(*dueTimes));
+            dueTail -= dueHead;
+            dueHead = 0;
+        }
+        if (dueTail == dueCapacity) {
+            dueCapacity = dueCapacity ? dueCapacity * 2 : 1024;
+            grown = realloc(dueTimes, dueCapacity * sizeof(*dueTimes));
+            if (grown == NULL) {
+                fprintf(stderr, "otp_load: ERROR queueing arrivals\n");
+                exit(1);
+            }
+            dueTimes = grown;
+        }
+    }
+    dueTimes[dueTail++] = due;
+}
+
+
+/***********************************************************
+ * parseAddress: fills in the address for a port, host:port
+ *               or Unix socket path, exiting if it can't.
+ *
+ * parameters: address, address length, endpoint.
+ * returns: none.
+ ***********************************************************/
+
+static void parseAddress(struct sockaddr_storage *address, socklen_t *length, const char *port) {
+    if (endpointAddress(port, address, length) < 0) {
+        fprintf(stderr, "otp_load: ERROR can't use endpoint %s: %s\n", port, strerror(errno));
+        exit(1);
+    }
+}
+
+
+/***********************************************************
+ * report: prints the results as one JSON object.
+ *
+ * parameters: load config, elapsed seconds.
+ * returns: none.
+ ***********************************************************/
+
+static void report(const struct loadConfig *config, double elapsed) {
+    long good = completed - errors[ERROR_IO] - errors[ERROR_STATUS] - errors[ERROR_MISMATCH];
+
+    printf("{\"label\":\"%s\",\"mode\":\"%s\",\"check\":\"%s\",\"concurrency\":%d,\"rate\":%.1f,"
+           "\"elapsed_s\":%.3f,\"requests\":%ld,\"ok\":%ld,"
+           "\"errors\":{\"io\":%ld,\"status\":%ld,\"mismatch\":%ld},"
+           "\"throughput_rps\":%.1f,\"throughput_mbps\":%.3f,"
+           "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+           config->label, config->rate > 0 ? "open" : "closed", config->checkByDecrypt ? "decrypt" : "local",
+           config->concurrency, config->rate, elapsed, completed, good,
+           errors[ERROR_IO], errors[ERROR_STATUS], errors[ERROR_MISMATCH],
+           elapsed > 0 ? good / elapsed : 0.0, elapsed > 0 ? bytesMoved / elapsed / 1e6 : 0.0,
+           latency.total ? latency.min / 1e3 : 0.0, latency.total ? latency.sum / latency.total / 1e3 : 0.0,
+           histPercentile(&latency, 50) / 1e3, histPercentile(&latency, 90) / 1e3,
+           histPercentile(&latency, 99) / 1e3, histPercentile(&latency, 99.9) / 1e3, latency.max / 1e3);
+}
+
+
+/***********************************************************
+ * main: parses the arguments and runs the load.
+ *
+ * parameters: number of arguments, argument array.
+ * returns: exit status.
+ ***********************************************************/
+
+int main(int argc, char *argv[]) {
+    struct loadConfig config;
+    struct loadClient *clients;
+    struct epoll_event events[LOAD_EVENTS];
+    double started, next, deadline, waitFor;
+    long issued = 0;
+    int opt, epollFD, ready, i, idle;
+
+    memset(&config, '\0', sizeof(config));
+    config.concurrency = 16;
+    config.requests = 1000;
+    config.label = "";
+    while ((opt = getopt(argc, argv, "d:c:r:t:n:s:f:L:z")) != -1) {
+        if (opt == 'd') {
+            parseAddress(&config.decrypt, &config.decryptLength, optarg);    //check by decrypting on this port or socket
+            config.checkByDecrypt = 1;
+        } else if (opt == 'c' && atoi(optarg) > 0) {
+            config.concurrency = atoi(optarg);    //clients, or most requests in flight when open loop
+        } else if (opt == 'r' && atof(optarg) > 0) {
+            config.rate = atof(optarg);    //open loop
+        } else if (opt == 't' && atof(optarg) > 0) {
+            config.duration = atof(optarg);
+            config.requests = 0;
+        } else if (opt == 'n' && atol(optarg) > 0) {
+            config.requests = atol(optarg);
+            config.duration = 0;
+        } else if (opt == 's' && strcmp(optarg, "corpus") == 0) {
+            config.sizeMode = SIZE_CORPUS;
+        } else if (opt == 's' && sscanf(optarg, "uniform:%ld:%ld", &config.sizeMin, &config.sizeMax) == 2 &&
+                   config.sizeMin >= 0 && config.sizeMax >= config.sizeMin) {
+            config.sizeMode = SIZE_UNIFORM;
+        } else if (opt == 's' && sscanf(optarg, "fixed:%ld", &config.sizeMin) == 1 && config.sizeMin >= 0) {
+            config.sizeMode = SIZE_FIXED;
+            config.sizeMax = config.sizeMin;
+        } else if (opt == 'f') {
+            loadCorpus(optarg);    //sample messages, plaintext1-4 by default
+        } else if (opt == 'L') {
+            config.label = optarg;    //tag for comparing runs, e.g. "epoll-avx2"
+        } else if (opt == 'z') {
+            config.packed = 1;    //packed text on the wire
+        } else {
+            optind = argc;    //force the usage message
+            break;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: %s [-d decport] [-c concurrency] [-r rate] [-t seconds | -n requests]\n"
+                        "       [-s corpus|fixed:N|uniform:MIN:MAX] [-f corpusfile]... [-L label] [-z] <encport>\n", argv[0]);
+        exit(1);
+    }
+    parseAddress(&config.encrypt, &config.encryptLength, argv[optind]);
+    if (corpusCount == 0) {
+        loadCorpus("plaintext1");
+        loadCorpus("plaintext2");
+        loadCorpus("plaintext3");
+        loadCorpus("plaintext4");
+    }
+    if (config.sizeMode == SIZE_CORPUS) {
+        for (i = 0; i < corpusCount; i++)
+            config.sizeMax = corpusSizes[i] > config.sizeMax ? corpusSizes[i] : config.sizeMax;
+    }
+    if (corpusLength == 0 || config.sizeMax > V2_MAX_LENGTH) {
+        fprintf(stderr, "otp_load: ERROR corpus is empty or sizes are over %d\n", V2_MAX_LENGTH);
+        exit(1);
+    }
+
+    if (config.packed && cipherSelect(NULL) == NULL) {    //vector packers and kernels, like the daemons
+        fprintf(stderr, "otp_load: ERROR no cipher kernel passed its self check\n");
+        exit(1);
+    }
+
+    srandom(getpid() ^ time(NULL));
+    keyPoolLength = config.sizeMax * 2 + 1;    //keys are cut from anywhere in here
+    keyPool = malloc(keyPoolLength);
+    clients = calloc(config.concurrency, sizeof(*clients));
+    epollFD = epoll_create1(0);
+    if (keyPool == NULL || clients == NULL || epollFD < 0) {
+        fprintf(stderr, "otp_load: ERROR setting up: %s\n", strerror(errno));
+        exit(1);
+    }
+    for (i = 0; i < (int) keyPoolLength; i++)
+        keyPool[i] = textAlphabet.symbols[random() % textAlphabet.size];
+    for (i = 0; i < config.concurrency; i++)
+        clients[i].fd = -1;
+    histInit(&latency);
+
+    started = next = now();
+    deadline = config.duration > 0 ? started + config.duration : 0;
+    while (1) {
+        double t = now();
+        int more = deadline > 0 ? t < deadline : issued < config.requests;
+
+        if (config.rate > 0) {    //open loop: arrivals keep their schedule, late ones queue
+            while (more && next <= t) {
+                queueArrival(next);
+                issued++;
+                next += -log((random() + 1.0) / (RAND_MAX + 2.0)) / config.rate;    //Poisson arrivals
+                more = deadline > 0 ? next < deadline : issued < config.requests;
+            }
+        }
+        for (i = 0, idle = 0; i < config.concurrency; i++) {
+            if (clients[i].busy)
+                continue;
+            if (config.rate > 0 && dueHead < dueTail) {
+                startRequest(epollFD, &clients[i], dueTimes[dueHead++], &config);    //latency counts the wait
+            } else if (config.rate == 0 && more) {
+                startRequest(epollFD, &clients[i], t, &config);
+                issued++;
+                more = deadline > 0 ? t < deadline : issued < config.requests;
+            } else {
+                idle++;
+            }
+        }
+        if (idle == config.concurrency && dueHead == dueTail && !more)    //everything issued has finished
+            break;
+
+        waitFor = config.rate > 0 && more ? (next - now()) * 1e3 : 100;
+        ready = epoll_wait(epollFD, events, LOAD_EVENTS, waitFor > 0 ? (int) waitFor + 1 : 0);
+        for (i = 0; i < ready; i++)
+            pumpClient(epollFD, events[i].data.ptr, &config);
+    }
+
+    report(&config, now() - started);
+    return completed > 0 && errors[ERROR_IO] + errors[ERROR_STATUS] + errors[ERROR_MISMATCH] == 0 ? 0 : 1;
+}
@@ -0,0 +1,405 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_metrics.c
+ *
+ * Overview:
+ * Shared-memory counter page for the daemons and the admin
+ * endpoint that reads it. Until metricsOpen is called every
+ * update is a no-op, so daemons run without -a pay nothing.
+ ************************************************************/
+
+#define _GNU_SOURCE    //sched_getcpu, accept4
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "otp_stream.h"
+#include "otp_metrics.h"
+
+#define METRICS_SLOTS 64          //per-CPU slots, CPUs past this share
+#define METRICS_RESPONSE 32768    //one scrape, well over what the format needs
+#define METRICS_SCRAPERS 4        //scrapes answered at once, more are turned away
+
+static const uint64_t latencyBounds[] = {    //nanoseconds
+    10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+    10000000, 25000000, 50000000, 100000000, 250000000, 500000000, 1000000000,
+    2500000000ULL, 5000000000ULL, 10000000000ULL
+};
+#define LATENCY_BUCKETS (sizeof(latencyBounds) / sizeof(latencyBounds[0]) + 1)    //last one is +Inf
+
+#define SIZE_FIRST 64       //message size buckets: 64 B, then every power of 4 up to 64 MiB
+#define SIZE_BUCKETS 12     //last one is +Inf
+
+struct metricsSlot {
+    uint64_t counters[METRIC_COUNTERS];
+    uint64_t latency[METRIC_PHASES][LATENCY_BUCKETS];
+    uint64_t latencySum[METRIC_PHASES];    //nanoseconds
+    uint64_t sizes[SIZE_BUCKETS];
+    uint64_t sizeSum;
+} __attribute__((aligned(64)));    //no two CPUs write the same line
+
+struct metricsPage {
+    struct metricsSlot slots[METRICS_SLOTS];
+    int64_t workers;    //gauge, kept by whoever forks the workers
+};
+
+static struct metricsPage *page;
+static int timing;    //metricsNow runs without the page, for tracing
+static const char *daemonName, *kernelName;
+static int scrapers;    //scrape threads running in this process
+
+static const char *const phaseNames[METRIC_PHASES] = {"handshake", "receive", "transform", "send", "total"};
+
+static const struct {
+    const char *name;
+    const char *help;
+} counterInfo[METRIC_COUNTERS] = {
+    {"otp_connections_accepted_total", "Connections accepted."},
+    {"otp_connections_completed_total", "Connections that finished cleanly."},
+    {"otp_connections_failed_total", "Connections cut short by an error or hang-up."},
+    {"otp_requests_rejected_total", "Requests refused: bad handshake, invalid input or pad range unavailable."},
+    {"otp_handshake_failures_total", "Handshakes no service answers."},
+    {"otp_bytes_received_total", "Bytes read from clients."},
+    {"otp_bytes_sent_total", "Bytes written to clients."},
+    {"otp_connections_timed_out_total", "Connections closed for missing the handshake, idle or request deadline."}
+};
+
+
+/***********************************************************
+ * metricsOpen: maps the shared counter page. must be called
+ *              before forking so every worker shares it.
+ *
+ * parameters: daemon and kernel names for otp_info.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+int metricsOpen(const char *daemon, const char *kernel) {
+    void *mapped = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped == MAP_FAILED) {
+        return -1;
+    }
+    page = mapped;    //anonymous memory starts zeroed
+    daemonName = daemon;
+    kernelName = kernel;
+    return 0;
+}
+
+
+/***********************************************************
+ * mySlot: the current CPU's slot.
+ *
+ * parameters: none.
+ * returns: slot.
+ ***********************************************************/
+
+static struct metricsSlot *mySlot(void) {
+    int cpu = sched_getcpu();
+
+    return &page->slots[cpu > 0 ? cpu % METRICS_SLOTS : 0];
+}
+
+
+/***********************************************************
+ * metricsTiming: keeps the phase timers running without the
+ *                counter page, for tracing.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+void metricsTiming(void) {
+    timing = 1;
+}
+
+
+/***********************************************************
+ * metricsNow: monotonic timestamp for the phase timers.
+ *
+ * parameters: none.
+ * returns: nanoseconds, 0 when metrics and tracing are off.
+ ***********************************************************/
+
+uint64_t metricsNow(void) {
+    struct timespec ts;
+
+    if (page == NULL && !timing) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/***********************************************************
+ * metricsAdd: adds to a counter.
+ *
+ * parameters: counter, amount.
+ * returns: none.
+ ***********************************************************/
+
+void metricsAdd(enum metricCounter counter, uint64_t value) {
+    if (page != NULL) {
+        __atomic_fetch_add(&mySlot()->counters[counter], value, __ATOMIC_RELAXED);    //another process may share the CPU
+    }
+}
+
+
+/***********************************************************
+ * metricsPhase: records how long one phase took.
+ *
+ * parameters: phase, nanoseconds.
+ * returns: none.
+ ***********************************************************/
+
+void metricsPhase(enum metricPhase phase, uint64_t nanoseconds) {
+    struct metricsSlot *slot;
+    size_t i;
+
+    if (page == NULL) {
+        return;
+    }
+    for (i = 0; i < LATENCY_BUCKETS - 1 && nanoseconds > latencyBounds[i]; i++)
+        ;
+    slot = mySlot();
+    __atomic_fetch_add(&slot->latency[phase][i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->latencySum[phase], nanoseconds, __ATOMIC_RELAXED);
+}
+
+
+/***********************************************************
+ * metricsMessage: records the size of one message.
+ *
+ * parameters: message length.
+ * returns: none.
+ ***********************************************************/
+
+void metricsMessage(uint64_t length) {
+    struct metricsSlot *slot;
+    uint64_t bound = SIZE_FIRST;
+    int i;
+
+    if (page == NULL) {
+        return;
+    }
+    for (i = 0; i < SIZE_BUCKETS - 1 && length > bound; i++)
+        bound *= 4;
+    slot = mySlot();
+    __atomic_fetch_add(&slot->sizes[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->sizeSum, length, __ATOMIC_RELAXED);
+}
+
+
+/***********************************************************
+ * metricsWorkers: moves the worker gauge. safe to call from
+ *                 a signal handler.
+ *
+ * parameters: change in live workers.
+ * returns: none.
+ ***********************************************************/
+
+void metricsWorkers(int delta) {
+    if (page != NULL) {
+        __atomic_fetch_add(&page->workers, delta, __ATOMIC_RELAXED);
+    }
+}
+
+
+/***********************************************************
+ * metricsListen: opens the admin port, on loopback only.
+ *
+ * parameters: port.
+ * returns: listening socket, -1 on error.
+ ***********************************************************/
+
+int metricsListen(int portNumber) {
+    struct sockaddr_in adminAddress;
+    int adminSocketFD, optimumValue = 1;
+
+    memset(&adminAddress, '\0', sizeof(adminAddress));
+    adminAddress.sin_family = AF_INET;
+    adminAddress.sin_port = htons(portNumber);
+    adminAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);    //metrics stay on this host
+
+    adminSocketFD = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);    //a scrape that vanishes mustn't block accept
+    if (adminSocketFD < 0) {
+        return -1;
+    }
+    setsockopt(adminSocketFD, SOL_SOCKET, SO_REUSEADDR, &optimumValue, sizeof(int));
+    if (bind(adminSocketFD, (struct sockaddr *) &adminAddress, sizeof(adminAddress)) < 0 || listen(adminSocketFD, 16) < 0) {
+        close(adminSocketFD);
+        return -1;
+    }
+    return adminSocketFD;
+}
+
+
+/***********************************************************
+ * metricsFormat: sums the slots into the Prometheus text
+ *                format.
+ *
+ * parameters: output buffer, its size.
+ * returns: length of the text.
+ ***********************************************************/
+
+static size_t metricsFormat(char *out, size_t size) {
+    struct metricsSlot total;    //each scrape sums on its own thread
+    uint64_t cumulative, count;
+    size_t used = 0, i, j, k;
+
+#define EMIT(...) used += snprintf(out + used, used < size ? size - used : 0, __VA_ARGS__)
+
+    memset(&total, '\0', sizeof(total));
+    for (k = 0; k < METRICS_SLOTS; k++) {    //a slot's fields may be mid-update, each one is still whole
+        for (i = 0; i < METRIC_COUNTERS; i++)
+            total.counters[i] += __atomic_load_n(&page->slots[k].counters[i], __ATOMIC_RELAXED);
+        for (i = 0; i < METRIC_PHASES; i++) {
+            for (j = 0; j < LATENCY_BUCKETS; j++)
+                total.latency[i][j] += __atomic_load_n(&page->slots[k].latency[i][j], __ATOMIC_RELAXED);
+            total.latencySum[i] += __atomic_load_n(&page->slots[k].latencySum[i], __ATOMIC_RELAXED);
+        }
+        for (j = 0; j < SIZE_BUCKETS; j++)
+            total.sizes[j] += __atomic_load_n(&page->slots[k].sizes[j], __ATOMIC_RELAXED);
+        total.sizeSum += __atomic_load_n(&page->slots[k].sizeSum, __ATOMIC_RELAXED);
+    }
+
+    EMIT("# HELP otp_info Daemon and the cipher kernel it runs.\n# TYPE otp_info gauge\n");
+    EMIT("otp_info{daemon=\"%s\",kernel=\"%s\"} 1\n", daemonName, kernelName);
+    for (i = 0; i < METRIC_COUNTERS; i++) {
+        EMIT("# HELP %s %s\n# TYPE %s counter\n", counterInfo[i].name, counterInfo[i].help, counterInfo[i].name);
+        EMIT("%s %llu\n", counterInfo[i].name, (unsigned long long) total.counters[i]);
+    }
+
+    count = total.counters[METRIC_COMPLETED] + total.counters[METRIC_FAILED];    //slots are summed while they change, keep it sane
+    EMIT("# HELP otp_connections_active Connections being served.\n# TYPE otp_connections_active gauge\n");
+    EMIT("otp_connections_active %llu\n", (unsigned long long) (total.counters[METRIC_ACCEPTED] > count ?
+                                                                 total.counters[METRIC_ACCEPTED] - count : 0));
+    EMIT("# HELP otp_workers Worker processes alive.\n# TYPE otp_workers gauge\n");
+    EMIT("otp_workers %lld\n", (long long) __atomic_load_n(&page->workers, __ATOMIC_RELAXED));
+
+    EMIT("# HELP otp_phase_seconds Time spent in each phase of a connection.\n# TYPE otp_phase_seconds histogram\n");
+    for (i = 0; i < METRIC_PHASES; i++) {
+        cumulative = 0;
+        for (j = 0; j < LATENCY_BUCKETS; j++) {
+            cumulative += total.latency[i][j];
+            if (j < LATENCY_BUCKETS - 1)
+                EMIT("otp_phase_seconds_bucket{phase=\"%s\",le=\"%g\"} %llu\n", phaseNames[i], latencyBounds[j] / 1e9,
+                     (unsigned long long) cumulative);
+            else
+                EMIT("otp_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n", phaseNames[i], (unsigned long long) cumulative);
+        }
+        EMIT("otp_phase_seconds_sum{phase=\"%s\"} %.9f\n", phaseNames[i], total.latencySum[i] / 1e9);
+        EMIT("otp_phase_seconds_count{phase=\"%s\"} %llu\n", phaseNames[i], (unsigned long long) cumulative);
+    }
+
+    EMIT("# HELP otp_message_bytes Size of each message transformed.\n# TYPE otp_message_bytes histogram\n");
+    cumulative = 0;
+    for (j = 0; j < SIZE_BUCKETS; j++) {
+        cumulative += total.sizes[j];
+        if (j < SIZE_BUCKETS - 1)
+            EMIT("otp_message_bytes_bucket{le=\"%llu\"} %llu\n", (unsigned long long) SIZE_FIRST << (2 * j), (unsigned long long) cumulative);
+        else
+            EMIT("otp_message_bytes_bucket{le=\"+Inf\"} %llu\n", (unsigned long long) cumulative);
+    }
+    EMIT("otp_message_bytes_sum %llu\n", (unsigned long long) total.sizeSum);
+    EMIT("otp_message_bytes_count %llu\n", (unsigned long long) cumulative);
+
+#undef EMIT
+    return used < size ? used : size - 1;
+}
+
+
+/***********************************************************
+ * metricsScrape: answers one scrape on its own thread. any
+ *                request gets the metrics back over
+ *                HTTP/1.0, and a client that doesn't send its
+ *                request promptly is dropped rather than
+ *                waited on.
+ *
+ * parameters: scrape connection, cast to a pointer.
+ * returns: NULL.
+ ***********************************************************/
+
+static void *metricsScrape(void *arg) {
+    int fd = (int) (intptr_t) arg;
+    struct timeval timeout = {1, 0};
+    char request[2048], *response;
+    size_t have = 0, header, body;
+    ssize_t n;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (have < sizeof(request) - 1) {    //read the request so closing doesn't reset the response
+        n = read(fd, request + have, sizeof(request) - 1 - have);
+        if (n <= 0) {
+            break;
+        }
+        have += n;
+        request[have] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+
+    response = malloc(METRICS_RESPONSE);
+    if (response != NULL) {
+        header = 128;    //room for the HTTP header in front of the body
+        body = metricsFormat(response + header, METRICS_RESPONSE - header);
+        n = snprintf(request, sizeof(request), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n", body);
+        memcpy(response + header - n, request, n);
+        writeFull(fd, response + header - n, n + body);
+        free(response);
+    }
+    close(fd);
+    __atomic_fetch_sub(&scrapers, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+
+/***********************************************************
+ * metricsServe: accepts a scrape on the admin port and
+ *               hands it to a thread of its own, so a slow
+ *               scraper never holds up the event loop that
+ *               noticed it.
+ *
+ * parameters: admin listening socket.
+ * returns: none.
+ ***********************************************************/
+
+void metricsServe(int adminSocketFD) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int fd, started;
+
+    fd = accept4(adminSocketFD, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (__atomic_add_fetch(&scrapers, 1, __ATOMIC_RELAXED) > METRICS_SCRAPERS) {    //enough already waiting on scrapers
+        __atomic_fetch_sub(&scrapers, 1, __ATOMIC_RELAXED);
+        close(fd);
+        return;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);    //the response is on the heap
+    started = pthread_create(&thread, &attr, metricsScrape, (void *) (intptr_t) fd) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started) {
+        __atomic_fetch_sub(&scrapers, 1, __ATOMIC_RELAXED);
+        close(fd);
+    }
+}
@@ -0,0 +1,54 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_metrics.h
+ *
+ * Overview:
+ * Daemon metrics. Counters and histograms live in one
+ * shared anonymous mapping made before any worker forks, so
+ * every process adds to the same numbers. The page is split
+ * into one cache-line aligned slot per CPU and updates are
+ * relaxed atomic adds to the current CPU's slot, so the hot
+ * path never takes a lock or bounces a line between CPUs;
+ * a scrape sums the slots. The totals are served in the
+ * Prometheus text format on a local admin port, each
+ * scrape on a thread of its own.
+ ************************************************************/
+
+#ifndef OTP_METRICS_H
+#define OTP_METRICS_H
+
+#include <stdint.h>
+
+enum metricCounter {
+    METRIC_ACCEPTED,         //connections accepted
+    METRIC_COMPLETED,        //connections that finished cleanly
+    METRIC_FAILED,           //connections cut short by an error or hang-up
+    METRIC_REJECTED,         //requests refused: bad handshake, bad input, pad range unavailable
+    METRIC_HANDSHAKE_FAILED, //handshakes no service answers
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_TIMED_OUT,        //connections closed for missing a deadline
+    METRIC_COUNTERS
+};
+
+enum metricPhase {
+    PHASE_HANDSHAKE,    //accept to protocol picked
+    PHASE_RECEIVE,      //protocol picked to the last request byte
+    PHASE_TRANSFORM,    //one call into the cipher kernel
+    PHASE_SEND,         //last request byte to the last response byte
+    PHASE_TOTAL,        //accept to close
+    METRIC_PHASES
+};
+
+int metricsOpen(const char *daemon, const char *kernel);
+void metricsTiming(void);
+uint64_t metricsNow(void);
+void metricsAdd(enum metricCounter counter, uint64_t value);
+void metricsPhase(enum metricPhase phase, uint64_t nanoseconds);
+void metricsMessage(uint64_t length);
+void metricsWorkers(int delta);
+int metricsListen(int portNumber);
+void metricsServe(int adminSocketFD);
+
+#endif
@@ -0,0 +1,404 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_offline.c
+ *
+ * Overview:
+ * Offline bulk mode. Every file is cut into chunks and the
+ * chunks of all the files are numbered as one run, which
+ * threads claim in order: a thread reads a chunk into its
+ * own buffer, transforms it against the pad mapping and
+ * writes it to the same offset of the output. Small files
+ * spread over the threads and one huge file does too, and
+ * memory stays at one chunk per thread however large the
+ * files are.
+ ************************************************************/
+
+#define _GNU_SOURCE    //scandir, alphasort
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "otp_cipher.h"
+#include "otp_stream.h"
+#include "otp_pad.h"
+#include "otp_offline.h"
+
+struct offlineFile {
+    char *input, *output;
+    int infd, outfd;
+    uint64_t length;         //message bytes, a text file's newline dropped
+    uint64_t keyOffset;      //start of its range in the pad
+    size_t firstChunk;       //number of its first chunk in the run
+    int error;               //errno of the first failure, 0 while fine
+};
+
+static struct {
+    struct offlineFile *files;
+    int count, capacity;
+    const char *key;         //pad data
+    int (*transform)(char *message, const char *key, size_t length);
+    size_t chunks;
+    size_t next;             //next chunk to claim
+} run;
+
+
+/***********************************************************
+ * addFile: appends a file to the run.
+ *
+ * parameters: input path, output directory.
+ * returns: 0 on success, -1 if out of memory.
+ ***********************************************************/
+
+static int addFile(const char *input, const char *outputDir) {
+    struct offlineFile *grown, *file;
+    char *copy;
+
+    if (run.count == run.capacity) {
+        run.capacity = run.capacity ? run.capacity * 2 : 64;
+        grown = realloc(run.files, run.capacity * sizeof(*run.files));
+        if (grown == NULL)
+            return -1;
+        run.files = grown;
+    }
+    file = &run.files[run.count];
+    memset(file, '\0', sizeof(*file));
+    file->infd = file->outfd = -1;
+    copy = strdup(input);
+    file->input = strdup(input);
+    if (copy == NULL || file->input == NULL || asprintf(&file->output, "%s/%s", outputDir, basename(copy)) < 0) {
+        free(copy);
+        free(file->input);
+        return -1;
+    }
+    free(copy);
+    run.count++;
+    return 0;
+}
+
+
+/***********************************************************
+ * addInputs: adds a file, or every regular file directly in
+ *            a directory in name order. dot files are
+ *            skipped.
+ *
+ * parameters: input path, output directory.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+static int addInputs(const char *input, const char *outputDir) {
+    struct dirent **entries;
+    struct stat info;
+    char *path;
+    int count, i, result = 0;
+
+    if (stat(input, &info) < 0)
+        return -1;
+    if (!S_ISDIR(info.st_mode))
+        return addFile(input, outputDir);
+
+    count = scandir(input, &entries, NULL, alphasort);
+    if (count < 0)
+        return -1;
+    for (i = 0; i < count; i++) {
+        if (result == 0 && entries[i]->d_name[0] != '.') {
+            if (asprintf(&path, "%s/%s", input, entries[i]->d_name) < 0) {
+                result = -1;
+            } else {
+                if (stat(path, &info) == 0 && S_ISREG(info.st_mode))
+                    result = addFile(path, outputDir);
+                free(path);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return result;
+}
+
+
+/***********************************************************
+ * openFile: opens a file's input and output and finds its
+ *           length. the output is sized up front, which
+ *           also drops whatever it held before.
+ *
+ * parameters: file, binary flag.
+ * returns: 0 on success, -1 with the file's error set.
+ ***********************************************************/
+
+static int openFile(struct offlineFile *file, int binary) {
+    struct stat inInfo, outInfo;
+    char last;
+
+    file->infd = open(file->input, O_RDONLY | O_CLOEXEC);
+    if (file->infd < 0 || fstat(file->infd, &inInfo) < 0) {
+        file->error = errno;
+        return -1;
+    }
+    file->length = inInfo.st_size;
+    if (!binary && file->length > 0) {    //drop the newline, like the client does before sending
+        if (pread(file->infd, &last, 1, file->length - 1) != 1) {
+            file->error = errno ? errno : EIO;
+            return -1;
+        }
+        if (last == '\n')
+            file->length--;
+    }
+    file->outfd = open(file->output, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);    //not truncated until we know it isn't the input
+    if (file->outfd < 0 || fstat(file->outfd, &outInfo) < 0) {
+        file->error = errno;
+        return -1;
+    }
+    if (outInfo.st_dev == inInfo.st_dev && outInfo.st_ino == inInfo.st_ino) {
+        close(file->outfd);
+        file->outfd = -1;    //nothing of the input's to remove
+        file->error = EEXIST;
+        return -1;
+    }
+    if (ftruncate(file->outfd, 0) < 0 || ftruncate(file->outfd, file->length + !binary) < 0) {    //text ends with a newline
+        file->error = errno;
+        return -1;
+    }
+    posix_fadvise(file->infd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+
+/***********************************************************
+ * runChunk: reads, transforms and writes one chunk.
+ *
+ * parameters: file, offset in the file, length, buffer.
+ * returns: 0 on success, an errno on failure.
+ ***********************************************************/
+
+static int runChunk(struct offlineFile *file, uint64_t offset, size_t length, char *buffer) {
+    size_t done;
+    ssize_t n;
+
+    for (done = 0; done < length; done += n) {
+        n = pread(file->infd, buffer + done, length - done, offset + done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            return n == 0 ? EIO : errno;    //shrank under us
+        }
+    }
+    if (run.transform(buffer, run.key + file->keyOffset + offset, length) < 0)
+        return EINVAL;    //message or pad holds chars outside the alphabet
+    for (done = 0; done < length; done += n) {
+        n = pwrite(file->outfd, buffer + done, length - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            return errno;
+        }
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * offlineWorker: claims chunks of the run until none are
+ *                left. the calling thread runs it too.
+ *
+ * parameters: unused.
+ * returns: NULL.
+ ***********************************************************/
+
+static void *offlineWorker(void *unused) {
+    char *buffer = malloc(OFFLINE_CHUNK);
+    struct offlineFile *file;
+    size_t chunk, length;
+    uint64_t offset;
+    int low, high, middle, error;
+
+    (void) unused;
+    while ((chunk = __atomic_fetch_add(&run.next, 1, __ATOMIC_RELAXED)) < run.chunks) {
+        low = 0;
+        high = run.count - 1;
+        while (low < high) {    //last file starting at or before the chunk
+            middle = (low + high + 1) / 2;
+            if (run.files[middle].firstChunk <= chunk)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        file = &run.files[low];
+        if (__atomic_load_n(&file->error, __ATOMIC_RELAXED) != 0)    //already lost, don't bother
+            continue;
+        offset = (uint64_t) (chunk - file->firstChunk) * OFFLINE_CHUNK;
+        length = file->length - offset < OFFLINE_CHUNK ? file->length - offset : OFFLINE_CHUNK;
+        error = buffer == NULL ? ENOMEM : runChunk(file, offset, length, buffer);
+        if (error != 0)
+            __atomic_store_n(&file->error, error, __ATOMIC_RELAXED);
+    }
+    free(buffer);
+    return NULL;
+}
+
+
+/***********************************************************
+ * openPad: loads the pad a padfile[:offset] spec names.
+ *          only that file and its ledger are opened, not
+ *          the rest of its directory.
+ *
+ * parameters: pad spec, offset out (PAD_ALLOCATE if none).
+ * returns: pad, NULL on error.
+ ***********************************************************/
+
+static struct pad *openPad(const char *padSpec, uint64_t *offset) {
+    char *path = strdup(padSpec), *directory, *colon, *slash;
+    struct pad *pad = NULL;
+    int dirfd;
+
+    if (path == NULL)
+        return NULL;
+    *offset = PAD_ALLOCATE;
+    slash = strrchr(path, '/');
+    colon = strrchr(slash != NULL ? slash : path, ':');    //only the file name can carry the offset
+    if (colon != NULL) {
+        *colon = '\0';
+        *offset = strtoull(colon + 1, NULL, 10);
+    }
+    if (slash != NULL) {
+        *slash = '\0';
+        directory = path[0] != '\0' ? path : "/";
+    } else {
+        directory = ".";
+    }
+    dirfd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);    //the ledger is created beside the pad
+    if (dirfd >= 0) {
+        pad = padOpenFile(dirfd, slash != NULL ? slash + 1 : path);
+        close(dirfd);
+    }
+    free(path);
+    return pad;
+}
+
+
+/***********************************************************
+ * runOffline: transforms files in this process with keys
+ *             from a pad, reports the throughput, and
+ *             removes the output of any file that failed.
+ *
+ * parameters: pad spec, input files and directories,
+ *             input count, output directory, threads
+ *             including the caller, binary flag, client
+ *             config.
+ * returns: exit status.
+ ***********************************************************/
+
+int runOffline(const char *padSpec, char **inputs, int count, const char *outputDir, int threads, int binary,
+               const struct clientConfig *config) {
+    const int decrypting = config->operation == V2_DECRYPT;
+    struct offlineFile *file;
+    struct timespec started, finished;
+    struct pad *pad;
+    pthread_t *workers;
+    uint64_t offset, start, total = 0, done = 0;
+    double seconds;
+    int i, running, failed = 0;
+
+    if (cipherSelect(NULL) == NULL) {    //the kernel the daemons would pick
+        fprintf(stderr, "%s: ERROR selecting cipher kernel\n", config->name);
+        return 1;
+    }
+    pad = openPad(padSpec, &offset);
+    if (pad == NULL) {
+        fprintf(stderr, "%s: ERROR loading pad %s: %s\n", config->name, padSpec, strerror(errno));
+        return 1;
+    }
+    if (mkdir(outputDir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: ERROR creating %s: %s\n", config->name, outputDir, strerror(errno));
+        return 1;
+    }
+    for (i = 0; i < count; i++) {
+        if (addInputs(inputs[i], outputDir) < 0) {
+            fprintf(stderr, "%s: ERROR reading %s: %s\n", config->name, inputs[i], strerror(errno));
+            return 1;
+        }
+    }
+
+    for (i = 0; i < run.count; i++) {    //open everything first, the range is claimed for what's left
+        file = &run.files[i];
+        if (openFile(file, binary) == 0) {
+            file->keyOffset = total;
+            total += file->length;
+        }
+    }
+    if (decrypting)    //decrypting needs a range that was used
+        start = offset != PAD_ALLOCATE && padCheck(pad, offset, total) ? offset : PAD_REFUSED;
+    else
+        start = padClaim(pad, offset, total);
+    if (start == PAD_REFUSED) {
+        fprintf(stderr, "%s: ERROR pad %s can't cover %llu bytes at %s\n", config->name, pad->id,
+                (unsigned long long) total, offset == PAD_ALLOCATE ? "its next unused offset" : "that offset");
+        for (i = 0; i < run.count; i++) {
+            if (run.files[i].outfd >= 0)
+                unlink(run.files[i].output);
+        }
+        return 1;
+    }
+
+    run.key = pad->data + start;
+    run.transform = binary ? byteAlphabet.encrypt : decrypting ? textAlphabet.decrypt : textAlphabet.encrypt;
+    for (i = 0; i < run.count; i++) {
+        file = &run.files[i];
+        file->firstChunk = run.chunks;
+        if (file->error == 0)
+            run.chunks += (file->length + OFFLINE_CHUNK - 1) / OFFLINE_CHUNK;
+    }
+    if (threads > (long) run.chunks)
+        threads = run.chunks > 0 ? run.chunks : 1;
+    workers = calloc(threads, sizeof(*workers));
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (running = 0; workers != NULL && running < threads - 1; running++) {    //the caller is the last one
+        if (pthread_create(&workers[running], NULL, offlineWorker, NULL) != 0)
+            break;
+    }
+    offlineWorker(NULL);
+    for (i = 0; i < running; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+
+    for (i = 0; i < run.count; i++) {
+        file = &run.files[i];
+        if (file->error == 0 && !binary && pwrite(file->outfd, "\n", 1, file->length) != 1)
+            file->error = errno ? errno : EIO;
+        if (file->outfd >= 0 && close(file->outfd) < 0 && file->error == 0)
+            file->error = errno;
+        if (file->infd >= 0)
+            close(file->infd);
+        if (file->error != 0) {
+            fprintf(stderr, "%s: ERROR %s: %s\n", config->name, file->input,
+                    file->error == EEXIST ? "output would overwrite it" : strerror(file->error));
+            if (file->outfd >= 0)
+                unlink(file->output);
+            failed++;
+        } else {
+            done += file->length;
+            if (!decrypting)    //each file can be decrypted on its own, offline or by a daemon
+                fprintf(stderr, "pad %s:%llu %s\n", pad->id, (unsigned long long) (start + file->keyOffset), file->output);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    fprintf(stderr, "%s: %d files, %llu bytes in %.3f s, %.1f MB/s on %d threads%s\n", config->name,
+            run.count - failed, (unsigned long long) done, seconds, seconds > 0 ? done / seconds / 1e6 : 0.0, threads,
+            failed > 0 ? ", some files failed" : "");
+    return failed > 0;
+}
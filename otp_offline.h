@@ -0,0 +1,27 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_offline.h
+ *
+ * Overview:
+ * Offline bulk mode for otp_enc / otp_dec: files and
+ * directories are transformed in the client process with
+ * the daemons' own kernels, no socket involved. Keys come
+ * from a pad through the same ledger the daemons use, so
+ * offline and daemon runs can share a pad without ever
+ * reusing a byte. Files get back-to-back ranges of the pad
+ * in the order given (a directory's files by name) and
+ * each output is what the daemon path would have printed.
+ ************************************************************/
+
+#ifndef OTP_OFFLINE_H
+#define OTP_OFFLINE_H
+
+#include "otp_client.h"
+
+#define OFFLINE_CHUNK (1 << 18)    //bytes a thread reads, transforms and writes at a time
+
+int runOffline(const char *padSpec, char **inputs, int count, const char *outputDir, int threads, int binary,
+               const struct clientConfig *config);
+
+#endif
@@ -0,0 +1,222 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_pad.c
+ *
+ * Overview:
+ * Key pad store for the daemons. Pads and their ledgers are
+ * mapped once at startup, before any worker forks, so every
+ * process claims ranges through the same shared ledger.
+ ************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "otp_pad.h"
+
+static const char ledgerSuffix[] = ".ledger";
+
+static struct pad pads[PAD_MAX];
+static int padCount;
+
+
+/***********************************************************
+ * openLedger: opens or creates a pad's ledger and maps its
+ *             mark shared, so claims made by one process
+ *             are seen by all of them.
+ *
+ * parameters: directory fd, pad ID.
+ * returns: mapped mark, NULL on error.
+ ***********************************************************/
+
+static uint64_t *openLedger(int dirfd, const char *id) {
+    char name[PAD_ID + sizeof(ledgerSuffix)];
+    struct stat info;
+    uint64_t *used;
+    int fd;
+
+    snprintf(name, sizeof(name), "%s%s", id, ledgerSuffix);
+    fd = openat(dirfd, name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        return NULL;
+    }
+    if (info.st_size < (off_t) sizeof(*used)) {    //new ledger, nothing used yet
+        if (ftruncate(fd, sizeof(*used)) < 0 || fsync(fd) < 0 || fsync(dirfd) < 0) {
+            close(fd);
+            return NULL;
+        }
+    }
+    used = mmap(NULL, sizeof(*used), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);    //the mapping keeps the file open
+    return used == MAP_FAILED ? NULL : used;
+}
+
+
+/***********************************************************
+ * padOpenFile: maps one pad along with its ledger. a text
+ *              pad's trailing newline is not part of it.
+ *
+ * parameters: directory fd, pad file name (the pad ID).
+ * returns: pad, NULL with errno set on error or if the
+ *          file is not a non-empty regular file.
+ ***********************************************************/
+
+struct pad *padOpenFile(int dirfd, const char *name) {
+    struct stat info;
+    struct pad *pad;
+    int fd;
+
+    if (strlen(name) >= PAD_ID) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    if (padCount == PAD_MAX) {
+        errno = EMFILE;
+        return NULL;
+    }
+    fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+        errno = S_ISDIR(info.st_mode) ? EISDIR : EINVAL;
+        close(fd);
+        return NULL;
+    }
+    pad = &pads[padCount];
+    pad->data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pad->data == MAP_FAILED) {
+        return NULL;
+    }
+    pad->size = info.st_size;
+    if (pad->data[pad->size - 1] == '\n') {    //drop the newline keygen ends with
+        pad->size--;
+    }
+    strcpy(pad->id, name);
+    pad->used = openLedger(dirfd, pad->id);
+    if (pad->used == NULL) {
+        munmap((void *) pad->data, info.st_size);
+        return NULL;
+    }
+    padCount++;
+    return pad;
+}
+
+
+/***********************************************************
+ * padOpen: maps every pad in a directory along with its
+ *          ledger. any non-empty regular file is a pad,
+ *          named by its file name.
+ *
+ * parameters: pad directory.
+ * returns: number of pads, -1 on error.
+ ***********************************************************/
+
+int padOpen(const char *directory) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    struct stat info;
+    size_t nameLength;
+
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        nameLength = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || nameLength >= PAD_ID) {
+            continue;
+        }
+        if (nameLength >= sizeof(ledgerSuffix) - 1 &&
+            strcmp(entry->d_name + nameLength - (sizeof(ledgerSuffix) - 1), ledgerSuffix) == 0) {    //a ledger, not a pad
+            continue;
+        }
+        if (fstatat(dirfd(dir), entry->d_name, &info, 0) < 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+            continue;
+        }
+        if (padOpenFile(dirfd(dir), entry->d_name) == NULL) {
+            break;
+        }
+    }
+    if (entry != NULL) {    //stopped early
+        closedir(dir);
+        return -1;
+    }
+    closedir(dir);
+    return padCount;
+}
+
+
+/***********************************************************
+ * padFind: looks up a loaded pad by ID.
+ *
+ * parameters: pad ID.
+ * returns: pad, NULL if there is no such pad.
+ ***********************************************************/
+
+struct pad *padFind(const char *id) {
+    int i;
+
+    for (i = 0; i < padCount; i++) {
+        if (strncmp(pads[i].id, id, PAD_ID) == 0) {
+            return &pads[i];
+        }
+    }
+    return NULL;
+}
+
+
+/***********************************************************
+ * padClaim: claims a range of the pad for encryption. the
+ *           ledger mark only moves forward, so a range is
+ *           free exactly when it starts at or past the mark;
+ *           anything skipped over is burned. the new mark is
+ *           on disk before this returns.
+ *
+ * parameters: pad, offset (PAD_ALLOCATE for the next unused
+ *             range), length.
+ * returns: offset of the claimed range, PAD_REFUSED if it
+ *          is already used or past the end of the pad.
+ ***********************************************************/
+
+uint64_t padClaim(struct pad *pad, uint64_t offset, uint64_t length) {
+    uint64_t used = __atomic_load_n(pad->used, __ATOMIC_ACQUIRE);
+    uint64_t start;
+
+    do {
+        start = offset == PAD_ALLOCATE ? used : offset;
+        if (start < used || start > pad->size || length > pad->size - start) {
+            errno = ENOSPC;
+            return PAD_REFUSED;
+        }
+    } while (!__atomic_compare_exchange_n(pad->used, &used, start + length, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    if (msync(pad->used, sizeof(*pad->used), MS_SYNC) < 0) {
+        return PAD_REFUSED;    //range stays burned, it just isn't used
+    }
+    return start;
+}
+
+
+/***********************************************************
+ * padCheck: checks that a range was claimed before, which
+ *           is what decrypting it needs.
+ *
+ * parameters: pad, offset, length.
+ * returns: 1 if the range was claimed, 0 if not.
+ ***********************************************************/
+
+int padCheck(const struct pad *pad, uint64_t offset, uint64_t length) {
+    uint64_t used = __atomic_load_n(pad->used, __ATOMIC_ACQUIRE);
+
+    return offset <= used && length <= used - offset;
+}
@@ -0,0 +1,52 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_pad.h
+ *
+ * Overview:
+ * Key pad store for the daemons. Pads are large key files
+ * kept on the server and mapped into memory, so a client
+ * sends only a pad ID and a range instead of the key. Every
+ * pad has a ledger holding how far into it has been used;
+ * encryption claims ranges past that mark atomically and
+ * the mark is synced to disk before any ciphertext goes
+ * out, so no pad byte is ever used twice.
+ *
+ * After the "enc_bs_pad" / "dec_bs_pad" handshake (or the
+ * "_pad_bytes" ones for binary data) the client sends a
+ * padRequest, the daemon answers with the 8-byte offset of
+ * the range (PAD_REFUSED if it can't be used), and the
+ * message follows as stream segments without the key half.
+ ************************************************************/
+
+#ifndef OTP_PAD_H
+#define OTP_PAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAD_ID 32                   //longest pad ID, including the NUL
+#define PAD_MAX 64                  //pads a daemon will load
+#define PAD_ALLOCATE UINT64_MAX     //request offset: daemon picks the next unused range
+#define PAD_REFUSED UINT64_MAX      //response offset: range can't be used
+
+struct padRequest {
+    char id[PAD_ID];
+    uint64_t offset;    //big-endian, PAD_ALLOCATE for the next unused range
+    uint64_t length;    //big-endian
+};
+
+struct pad {
+    char id[PAD_ID];
+    const char *data;    //whole pad, mapped read-only
+    uint64_t size;
+    uint64_t *used;      //ledger mark, mapped shared with every other process using the pad
+};
+
+int padOpen(const char *directory);
+struct pad *padOpenFile(int dirfd, const char *name);
+struct pad *padFind(const char *id);
+uint64_t padClaim(struct pad *pad, uint64_t offset, uint64_t length);
+int padCheck(const struct pad *pad, uint64_t offset, uint64_t length);
+
+#endif
@@ -0,0 +1,193 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_parallel.c
+ *
+ * Overview:
+ * Thread pool for transforming large messages. The pool is
+ * started the first time a process needs it rather than at
+ * startup, so the daemons never fork with threads running
+ * and each forked child or worker gets its own pool. Only
+ * one transform runs at a time per process, which is all a
+ * daemon process ever does; the caller takes chunks too and
+ * waits for the threads that joined before returning.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "otp_parallel.h"
+
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;            //a job was posted
+    pthread_cond_t done;            //the last thread left the job
+    int threads;                    //including the caller
+    size_t threshold;
+    pid_t owner;                    //process the threads were started in, 0 before
+    unsigned long generation;       //bumped for every job
+    int open;                       //threads may still join the current job
+    int active;                     //threads working on it
+
+    segmentTransform transform;
+    char *message;
+    const char *key;
+    size_t length;
+    size_t chunks;
+    size_t next;                    //next chunk to claim
+    int failed;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .threads = 1,
+    .threshold = PARALLEL_THRESHOLD
+};
+
+
+/***********************************************************
+ * runChunks: claims chunks of the current job until none
+ *            are left.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void runChunks(void) {
+    size_t chunk, start, length;
+
+    while ((chunk = __atomic_fetch_add(&pool.next, 1, __ATOMIC_RELAXED)) < pool.chunks) {
+        start = chunk * PARALLEL_CHUNK;
+        length = pool.length - start < PARALLEL_CHUNK ? pool.length - start : PARALLEL_CHUNK;
+        if (pool.transform(pool.message + start, pool.key + start, length) < 0) {
+            __atomic_store_n(&pool.failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+
+/***********************************************************
+ * parallelWorker: pool thread, joins each job while it's
+ *                 open.
+ *
+ * parameters: unused.
+ * returns: never.
+ ***********************************************************/
+
+static void *parallelWorker(void *unused) {
+    unsigned long seen = 0;
+
+    (void) unused;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.open || pool.generation == seen) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        seen = pool.generation;
+        pool.active++;
+        pthread_mutex_unlock(&pool.lock);
+        runChunks();
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.active == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    return NULL;
+}
+
+
+/***********************************************************
+ * startPool: starts the pool threads in this process. a
+ *            forked child inherits the parent's state but
+ *            none of its threads, so it starts over.
+ *
+ * parameters: none.
+ * returns: 0, or -1 if no thread could be started.
+ ***********************************************************/
+
+static int startPool(void) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int i, started = 0;
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.open = 0;
+    pool.active = 0;
+    pool.owner = getpid();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);    //workers only call the cipher kernels
+    for (i = 1; i < pool.threads; i++) {
+        if (pthread_create(&thread, &attr, parallelWorker, NULL) == 0) {
+            started++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    if (started == 0) {
+        pool.threads = 1;    //run everything on the caller from now on
+        return -1;
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * parallelOpen: sets the pool size and threshold. threads
+ *               start on first use.
+ *
+ * parameters: threads including the caller (1 turns the
+ *             pool off), smallest message to split.
+ * returns: none.
+ ***********************************************************/
+
+void parallelOpen(int threads, size_t threshold) {
+    pool.threads = threads > 1 ? threads : 1;
+    pool.threshold = threshold > PARALLEL_CHUNK ? threshold : PARALLEL_CHUNK;
+}
+
+
+/***********************************************************
+ * parallelTransform: runs a transform over the message,
+ *                    split across the pool when it's over
+ *                    the threshold.
+ *
+ * parameters: transform, message (transformed in place),
+ *             key, length.
+ * returns: 0, or -1 on invalid input in any chunk.
+ ***********************************************************/
+
+int parallelTransform(segmentTransform transform, char *message, const char *key, size_t length) {
+    if (pool.threads < 2 || length < pool.threshold) {
+        return transform(message, key, length);
+    }
+    if (pool.owner != getpid() && startPool() < 0) {
+        return transform(message, key, length);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.transform = transform;
+    pool.message = message;
+    pool.key = key;
+    pool.length = length;
+    pool.chunks = (length + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    pool.next = 0;
+    pool.failed = 0;
+    pool.open = 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    runChunks();
+
+    pthread_mutex_lock(&pool.lock);
+    pool.open = 0;    //late wakers wait for the next job
+    while (pool.active > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return pool.failed ? -1 : 0;
+}
@@ -0,0 +1,27 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_parallel.h
+ *
+ * Overview:
+ * Splits one large transform across a pool of threads.
+ * Every byte depends only on the message and key bytes at
+ * the same offset, so the message is cut into cache-sized
+ * chunks that threads claim in order and transform in
+ * place. Messages under the threshold run on the calling
+ * thread exactly as before.
+ ************************************************************/
+
+#ifndef OTP_PARALLEL_H
+#define OTP_PARALLEL_H
+
+#include <stddef.h>
+#include "otp_stream.h"
+
+#define PARALLEL_CHUNK (1 << 18)         //bytes one thread transforms at a time, message and key fit in L2
+#define PARALLEL_THRESHOLD (1 << 20)     //smallest message worth waking the pool for
+
+void parallelOpen(int threads, size_t threshold);
+int parallelTransform(segmentTransform transform, char *message, const char *key, size_t length);
+
+#endif
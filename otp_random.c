@@ -0,0 +1,111 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_random.c
+ *
+ * Overview:
+ * ChaCha20 key generator used by keygen.
+ ************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <sys/random.h>
+#include "otp_cipher.h"
+#include "otp_random.h"
+
+#define ROTATE(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = ROTATE(d, 16); \
+    c += d; b ^= c; b = ROTATE(b, 12); \
+    a += b; d ^= a; d = ROTATE(d, 8); \
+    c += d; b ^= c; b = ROTATE(b, 7)
+
+
+/***********************************************************
+ * randomSeed: keys a ChaCha20 generator from getrandom.
+ *
+ * parameters: generator.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+int randomSeed(struct randomState *rng) {
+    static const uint32_t constants[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};    //"expand 32-byte k"
+    size_t have = 0;
+    ssize_t n;
+
+    memcpy(rng->state, constants, sizeof(constants));
+    while (have < 32) {    //256-bit key
+        n = getrandom((char *) &rng->state[4] + have, 32 - have, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        have += n;
+    }
+    rng->state[12] = rng->state[13] = 0;    //block counter
+    rng->state[14] = rng->state[15] = 0;    //nonce, every generator has its own key
+    rng->used = sizeof(rng->block);
+    return 0;
+}
+
+
+/***********************************************************
+ * randomByte: next random byte from the generator.
+ *
+ * parameters: generator.
+ * returns: random byte.
+ ***********************************************************/
+
+unsigned char randomByte(struct randomState *rng) {
+    uint32_t *x = rng->block;
+    int i;
+
+    if (rng->used == sizeof(rng->block)) {    //out of bytes, run the block function
+        memcpy(x, rng->state, sizeof(rng->block));
+        for (i = 0; i < 10; i++) {    //20 rounds, column then diagonal
+            QUARTER(x[0], x[4], x[8], x[12]);
+            QUARTER(x[1], x[5], x[9], x[13]);
+            QUARTER(x[2], x[6], x[10], x[14]);
+            QUARTER(x[3], x[7], x[11], x[15]);
+            QUARTER(x[0], x[5], x[10], x[15]);
+            QUARTER(x[1], x[6], x[11], x[12]);
+            QUARTER(x[2], x[7], x[8], x[13]);
+            QUARTER(x[3], x[4], x[9], x[14]);
+        }
+        for (i = 0; i < 16; i++)
+            x[i] += rng->state[i];
+        if (++rng->state[12] == 0)
+            rng->state[13]++;
+        rng->used = 0;
+    }
+    return ((unsigned char *) x)[rng->used++];
+}
+
+
+/***********************************************************
+ * randomKey: fills a buffer with key for an alphabet. text
+ *            keys use rejection sampling, so every symbol is
+ *            equally likely instead of the low ones winning
+ *            the leftover from 256 % 27.
+ *
+ * parameters: generator, buffer, length, alphabet.
+ * returns: none.
+ ***********************************************************/
+
+void randomKey(struct randomState *rng, char *key, size_t length, const struct cipherAlphabet *alphabet) {
+    const int limit = 256 - 256 % alphabet->size;    //largest multiple of the alphabet size
+    unsigned char r;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        r = randomByte(rng);
+        if (alphabet->symbols == NULL) {    //every byte is a symbol
+            key[i] = r;
+            continue;
+        }
+        while (r >= limit)    //biased tail, draw again
+            r = randomByte(rng);
+        key[i] = alphabet->symbols[r % alphabet->size];
+    }
+}
@@ -0,0 +1,30 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_random.h
+ *
+ * Overview:
+ * ChaCha20 key generator used by keygen. Each generator is
+ * keyed from getrandom and owned by one thread, so there is
+ * no locking on the hot path.
+ ************************************************************/
+
+#ifndef OTP_RANDOM_H
+#define OTP_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct cipherAlphabet;
+
+struct randomState {
+    uint32_t state[16];
+    uint32_t block[16];
+    int used;    //bytes of block already handed out
+};
+
+int randomSeed(struct randomState *rng);
+unsigned char randomByte(struct randomState *rng);
+void randomKey(struct randomState *rng, char *key, size_t length, const struct cipherAlphabet *alphabet);
+
+#endif
@@ -0,0 +1,1655 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_server.c
+ *
+ * Overview:
+ * Daemon core shared by otp_enc_d, otp_dec_d and otp_d: the
+ * connection state machine and the server modes that drive
+ * it: fork per connection, a pre-forked worker pool, and a
+ * single-process epoll event loop. The io_uring mode lives
+ * in otp_uring.c.
+ ************************************************************/
+
+#define _GNU_SOURCE    //accept4, be64toh
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <arpa/inet.h>
+#include "otp_cipher.h"
+#include "otp_server.h"
+#include "otp_metrics.h"
+#include "otp_uring.h"
+#include "otp_parallel.h"
+#include "otp_buffer.h"
+#include "otp_trace.h"
+
+#define SERVER_FORK 0
+#define SERVER_EPOLL 1
+#define SERVER_PREFORK 2
+#define SERVER_URING 3
+#define SERVER_SHARD 4
+
+#define LISTEN_MAX 2       //a TCP port and a Unix socket
+#define EPOLL_EVENTS 64    //events handled per epoll_wait
+#define EPOLL_BUDGET 16    //reads or writes per connection per wakeup, so one big stream can't starve the rest
+
+static const char invalidResponse[] = "invalid";
+static char legacyPadding[16384];    //NULs for the end of legacy responses, sent as often as needed
+
+const struct serviceConfig cipherServices[] = {
+    {"enc_bs", "enc_d_bs", 0},
+    {"dec_bs", "dec_d_bs", 1}
+};
+
+static const struct {
+    const char *suffix;    //appended to the service's handshake
+    enum connState state;
+    const struct cipherAlphabet *alphabet;
+    int persistent;        //zero length ends a message, not the connection
+} protocols[] = {
+    {"", CONN_LEGACY, &textAlphabet, 0},                //newline-delimited text
+    {"_stream", CONN_HEADER, &textAlphabet, 0},         //segmented text
+    {"_stream_bytes", CONN_HEADER, &byteAlphabet, 0},   //segmented binary, XOR
+    {"_pad", CONN_PAD, &textAlphabet, 0},               //segmented text, key from a server pad
+    {"_pad_bytes", CONN_PAD, &byteAlphabet, 0},         //segmented binary, key from a server pad
+    {"_batch", CONN_HEADER, &textAlphabet, 1},          //segmented text, many messages
+    {"_batch_bytes", CONN_HEADER, &byteAlphabet, 1}     //segmented binary, many messages
+};
+
+static int padsLoaded;    //pad protocols are only offered with -p
+static int adminSocketFD = -1;    //metrics endpoint, only with -a
+static int listenFDs[LISTEN_MAX];  //every socket clients connect to
+static int listenCount;
+static int listenPolled;           //more than one socket to wait on, so the listeners don't block
+static int listenBacklog = SOMAXCONN;    //pending connections each listener holds
+static int *shardFDs;              //one SO_REUSEPORT listener per shard, kept open by the supervisor; NULL for a Unix endpoint
+static int *shardCPUs;             //CPU each shard is pinned to
+static int shardCount;
+static char adminMarker;          //epoll data for the admin socket
+static struct timerWheel connTimers;    //event loop connections by deadline
+
+static struct {
+    uint64_t handshake;    //accept to protocol picked
+    uint64_t idle;         //longest wait for the client to send or take a byte
+    uint64_t request;      //accept, or a persistent connection's last message, to done
+} timeouts = {10000, 60000, 0};    //milliseconds, 0 for none
+
+
+/***********************************************************
+ * fatal: prints the server's error statement and exits.
+ *
+ * parameters: server config, what failed.
+ * returns: none.
+ ***********************************************************/
+
+static void fatal(const struct serverConfig *config, const char *what) {
+    fprintf(stderr, "%s: ERROR %s: %s\n", config->name, what, strerror(errno));
+    exit(1);
+}
+
+
+/***********************************************************
+ * connInit: starts a connection in the handshake state.
+ *
+ * parameters: connection, socket, server config.
+ * returns: none.
+ ***********************************************************/
+
+void connInit(struct connection *conn, int fd, const struct serverConfig *config) {
+    memset(conn, '\0', sizeof(*conn));
+    conn->fd = fd;
+    conn->config = config;
+    conn->state = CONN_HANDSHAKE;
+    conn->acceptedAt = metricsNow();
+    conn->traceId = traceRequest();
+    if (timeouts.handshake > 0 || timeouts.idle > 0 || timeouts.request > 0) {
+        conn->requestAt = conn->activeAt = timerNow();
+    }
+    metricsAdd(METRIC_ACCEPTED, 1);
+}
+
+
+/***********************************************************
+ * endPhase: records a finished phase in the metrics and the
+ *           trace.
+ *
+ * parameters: connection, phase, start and end timestamps,
+ *             bytes the phase covered.
+ * returns: none.
+ ***********************************************************/
+
+static void endPhase(const struct connection *conn, enum metricPhase phase, uint64_t start, uint64_t end, uint64_t bytes) {
+    metricsPhase(phase, end - start);
+    traceSpan(conn->traceId, phase, start, end, bytes);
+}
+
+
+/***********************************************************
+ * connFree: releases a connection's buffers and records how
+ *           it ended. does not close the socket.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+void connFree(struct connection *conn) {
+    uint64_t now = metricsNow();
+
+    if (connDone(conn)) {
+        metricsAdd(METRIC_COMPLETED, 1);
+        if (conn->receivedAt != 0) {
+            endPhase(conn, PHASE_SEND, conn->receivedAt, now, 0);
+        }
+        endPhase(conn, PHASE_TOTAL, conn->acceptedAt, now, 0);
+    } else {
+        metricsAdd(METRIC_FAILED, 1);
+    }
+    bufferPut(&conn->memory, conn->buffer, conn->capacity);
+    bufferPut(&conn->memory, conn->message, STREAM_SEGMENT);
+    bufferPut(&conn->memory, conn->key, STREAM_SEGMENT);
+    conn->buffer = conn->message = conn->key = NULL;
+}
+
+
+/***********************************************************
+ * queueOutput: hands bytes to the driver to send.
+ *
+ * parameters: connection, data, length.
+ * returns: none.
+ ***********************************************************/
+
+static void queueOutput(struct connection *conn, const char *data, size_t length) {
+    conn->out = data;
+    conn->outLength = length;
+    conn->outPos = 0;
+}
+
+
+/***********************************************************
+ * reject: answers a bad handshake with "invalid" and closes.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void reject(struct connection *conn) {
+    metricsAdd(METRIC_HANDSHAKE_FAILED, 1);
+    metricsAdd(METRIC_REJECTED, 1);
+    queueOutput(conn, invalidResponse, sizeof(invalidResponse));
+    conn->state = CONN_CLOSING;
+}
+
+
+/***********************************************************
+ * transform: runs the connection's cipher transform, split
+ *            across threads when the message is large, and
+ *            times it.
+ *
+ * parameters: connection, message, key, length.
+ * returns: transform result, below 0 on invalid input.
+ ***********************************************************/
+
+static int transform(struct connection *conn, char *message, const char *key, size_t length) {
+    uint64_t start = metricsNow();
+    int result = parallelTransform(conn->transform, message, key, length);
+
+    if (start != 0) {
+        endPhase(conn, PHASE_TRANSFORM, start, metricsNow(), length);
+    }
+    if (result < 0) {
+        metricsAdd(METRIC_REJECTED, 1);
+    }
+    return result;
+}
+
+
+/***********************************************************
+ * finishHandshake: picks the protocol from a complete
+ *                  handshake and confirms it.
+ *
+ * parameters: connection.
+ * returns: 0 on success, -1 if out of memory or over
+ *          budget.
+ ***********************************************************/
+
+static int finishHandshake(struct connection *conn) {
+    const struct serverConfig *config = conn->config;
+    const struct serviceConfig *service = NULL;
+    size_t prefix, i;
+    int j;
+
+    for (j = 0; j < config->serviceCount; j++) {    //find the service and protocol the client asked for
+        service = &config->services[j];
+        prefix = strlen(service->handshake);
+        if (strncmp(conn->handshake, service->handshake, prefix) != 0) {
+            continue;
+        }
+        for (i = 0; i < sizeof(protocols) / sizeof(protocols[0]); i++) {
+            if (protocols[i].state == CONN_PAD && !padsLoaded) {
+                continue;
+            }
+            if (strcmp(conn->handshake + prefix, protocols[i].suffix) == 0) {
+                break;
+            }
+        }
+        if (i < sizeof(protocols) / sizeof(protocols[0])) {
+            break;
+        }
+    }
+    if (j == config->serviceCount) {
+        reject(conn);
+        return 0;
+    }
+    conn->service = service;
+    conn->transform = service->decrypting ? protocols[i].alphabet->decrypt : protocols[i].alphabet->encrypt;
+    conn->state = protocols[i].state;
+    conn->persistent = protocols[i].persistent;
+    conn->handshakeAt = metricsNow();
+    endPhase(conn, PHASE_HANDSHAKE, conn->acceptedAt, conn->handshakeAt, 0);
+
+    if (conn->state == CONN_HEADER) {    //streaming client, two fixed segment buffers
+        conn->message = bufferGet(&conn->memory, STREAM_SEGMENT);
+        conn->key = bufferGet(&conn->memory, STREAM_SEGMENT);
+        if (conn->message == NULL || conn->key == NULL) {
+            return -1;
+        }
+    } else if (conn->state == CONN_PAD) {    //pad client, the key is already mapped
+        conn->message = bufferGet(&conn->memory, STREAM_SEGMENT);
+        if (conn->message == NULL) {
+            return -1;
+        }
+    } else {    //legacy client, buffer grows as input arrives
+        conn->buffer = bufferGet(&conn->memory, 4096);
+        if (conn->buffer == NULL) {
+            return -1;
+        }
+        conn->capacity = 4096;
+    }
+    queueOutput(conn, service->response, strlen(service->response) + 1);    //write authority confirmation back to client
+    return 0;
+}
+
+
+/***********************************************************
+ * replyV2: queues a v2 response header and the result that
+ *          sits right after it in the buffer, then closes.
+ *
+ * parameters: connection, status, result length.
+ * returns: none.
+ ***********************************************************/
+
+static void replyV2(struct connection *conn, int status, uint32_t length) {
+    struct v2Header *reply = conn->buffer != NULL ? (struct v2Header *) conn->buffer : &conn->v2;
+    int packed = status == V2_OK && (ntohs(conn->v2.flags) & V2_PACKED);    //read before reply can overwrite it
+
+    memcpy(reply->magic, V2_MAGIC, sizeof(reply->magic));
+    reply->version = V2_VERSION;
+    reply->code = status;
+    reply->flags = htons(packed ? V2_PACKED : 0);
+    reply->length = htonl(length);
+    reply->keyLength = 0;
+    if (status != V2_OK) {
+        metricsAdd(METRIC_REJECTED, 1);
+    }
+    queueOutput(conn, (const char *) reply, sizeof(*reply) + (packed ? PACKED_LENGTH(length) : length));
+    conn->state = CONN_CLOSING;
+}
+
+
+/***********************************************************
+ * startV2: reads a v2 request header out of the handshake
+ *          buffer, picks the service and alphabet and makes
+ *          room for the message and key. any payload bytes
+ *          that came in with the header are moved over.
+ *
+ * parameters: connection.
+ * returns: 0 on success, -1 if out of memory.
+ ***********************************************************/
+
+static int startV2(struct connection *conn) {
+    const struct cipherAlphabet *alphabet;
+    size_t extra = conn->handshakeLength - sizeof(conn->v2), start;
+    uint32_t length, keyLength;
+    int j, flags;
+
+    memcpy(&conn->v2, conn->handshake, sizeof(conn->v2));
+    length = ntohl(conn->v2.length);
+    keyLength = ntohl(conn->v2.keyLength);
+    flags = ntohs(conn->v2.flags);
+    for (j = 0; j < conn->config->serviceCount; j++) {    //the operation picks the service, no handshake needed
+        if (conn->config->services[j].decrypting == (conn->v2.code == V2_DECRYPT)) {
+            break;
+        }
+    }
+    if (conn->v2.version != V2_VERSION || (conn->v2.code != V2_ENCRYPT && conn->v2.code != V2_DECRYPT) ||
+        j == conn->config->serviceCount || ((flags & V2_PACKED) && (flags & V2_BINARY))) {    //only text packs
+        metricsAdd(METRIC_HANDSHAKE_FAILED, 1);
+        replyV2(conn, V2_REFUSED, 0);
+        return 0;
+    }
+    conn->handshakeAt = metricsNow();    //the header stands in for the handshake
+    endPhase(conn, PHASE_HANDSHAKE, conn->acceptedAt, conn->handshakeAt, 0);
+    if (length > V2_MAX_LENGTH || keyLength > V2_MAX_LENGTH || keyLength < length) {
+        replyV2(conn, V2_TOO_LARGE, 0);
+        return 0;
+    }
+
+    alphabet = flags & V2_BINARY ? &byteAlphabet : &textAlphabet;
+    conn->service = &conn->config->services[j];
+    conn->transform = conn->service->decrypting ? alphabet->decrypt : alphabet->encrypt;
+    conn->capacity = sizeof(conn->v2) + (size_t) length + keyLength;    //room for the reply header in front
+    start = sizeof(conn->v2);
+    if (flags & V2_PACKED) {    //packed bytes land after the room they unpack into
+        start = conn->capacity;
+        conn->capacity += PACKED_LENGTH((size_t) length) + PACKED_LENGTH((size_t) keyLength);
+    }
+    if (extra > conn->capacity - start) {    //more payload than the header announced
+        return -1;
+    }
+    conn->buffer = bufferGet(&conn->memory, conn->capacity);
+    if (conn->buffer == NULL && (errno == EMSGSIZE || errno == ENOBUFS)) {    //over budget is an answer, not a failure
+        replyV2(conn, errno == ENOBUFS ? V2_BUSY : V2_TOO_LARGE, 0);
+        return 0;
+    }
+    if (conn->buffer == NULL) {
+        return -1;
+    }
+    conn->length = start + extra;
+    memcpy(conn->buffer + start, conn->handshake + sizeof(conn->v2), extra);
+    conn->state = CONN_V2;
+    return connReceived(conn, 0);    //the whole request may have come in the first read
+}
+
+
+/***********************************************************
+ * finishV2: transforms a complete v2 request and queues the
+ *           result, exactly as long as the message, unpacking
+ *           and packing around the transform if asked.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void finishV2(struct connection *conn) {
+    uint32_t length = ntohl(conn->v2.length);
+    char *message = conn->buffer + sizeof(conn->v2);
+    const unsigned char *packed = (const unsigned char *) message + length + ntohl(conn->v2.keyLength);
+    int isPacked = ntohs(conn->v2.flags) & V2_PACKED;
+
+    metricsMessage(length);
+    if (isPacked && (unpackText(message, packed, length) < 0 ||
+                     unpackText(message + length, packed + PACKED_LENGTH(length), length) < 0)) {    //only the key's first length symbols are used
+        replyV2(conn, V2_INVALID, 0);
+        return;
+    }
+    if (transform(conn, message, message + length, length) < 0) {
+        replyV2(conn, V2_INVALID, 0);
+        return;
+    }
+    if (isPacked) {
+        packText((unsigned char *) message, message, length);    //in place, the result is already valid text
+    }
+    replyV2(conn, V2_OK, length);
+}
+
+
+/***********************************************************
+ * finishLegacy: transforms a complete legacy request and
+ *               queues the NUL-padded response.
+ *
+ * parameters: connection.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+static int finishLegacy(struct connection *conn) {
+    size_t messageLength = conn->keyStart - 1;    //message ends at the first newline
+
+    if (conn->length - conn->keyStart < messageLength) {    //key must cover the message
+        errno = EPROTO;
+        return -1;
+    }
+    metricsMessage(messageLength);
+    if (transform(conn, conn->buffer, conn->buffer + conn->keyStart, messageLength) < 0) {
+        errno = EINVAL;    //message or key holds chars outside the alphabet
+        return -1;
+    }
+    queueOutput(conn, conn->buffer, messageLength);
+    conn->padding = LEGACY_BUFFER - messageLength;    //legacy clients expect the full buffer back
+    conn->state = CONN_CLOSING;
+    return 0;
+}
+
+
+/***********************************************************
+ * finishPadRequest: claims (encrypting) or checks
+ *                   (decrypting) the requested pad range and
+ *                   answers with its offset.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void finishPadRequest(struct connection *conn) {
+    uint64_t offset = be64toh(conn->request.offset);
+
+    conn->padLength = be64toh(conn->request.length);
+    conn->request.id[PAD_ID - 1] = '\0';
+    conn->pad = padFind(conn->request.id);
+    conn->padStart = PAD_REFUSED;
+    if (conn->pad == NULL) {
+        //no such pad
+    } else if (!conn->service->decrypting) {    //encrypting uses up the range
+        conn->padStart = padClaim(conn->pad, offset, conn->padLength);
+    } else if (offset != PAD_ALLOCATE && padCheck(conn->pad, offset, conn->padLength)) {    //decrypting needs a used one
+        conn->padStart = offset;
+    }
+
+    if (conn->padStart == PAD_REFUSED) {
+        metricsAdd(METRIC_REJECTED, 1);
+    }
+    conn->padReply = htobe64(conn->padStart);
+    queueOutput(conn, (const char *) &conn->padReply, sizeof(conn->padReply));
+    conn->state = conn->padStart == PAD_REFUSED ? CONN_CLOSING : CONN_HEADER;
+}
+
+
+/***********************************************************
+ * connInput: tells the driver where the next bytes from the
+ *            socket should go. nothing is read while output
+ *            is pending, which keeps memory bounded.
+ *
+ * parameters: connection, pointer to receive the target.
+ * returns: number of bytes wanted, 0 if none right now.
+ ***********************************************************/
+
+size_t connInput(struct connection *conn, char **target) {
+    if (conn->outPos < conn->outLength || conn->padding > 0) {
+        return 0;
+    }
+    switch (conn->state) {
+    case CONN_HANDSHAKE:
+        *target = conn->handshake + conn->handshakeLength;
+        return sizeof(conn->handshake) - 1 - conn->handshakeLength;
+    case CONN_PAD:
+        *target = (char *) &conn->request + conn->padHave;
+        return sizeof(conn->request) - conn->padHave;
+    case CONN_LEGACY:
+    case CONN_V2:
+        *target = conn->buffer + conn->length;
+        return conn->capacity - conn->length;
+    case CONN_HEADER:
+        *target = (char *) &conn->header + conn->have;
+        return sizeof(conn->header) - conn->have;
+    case CONN_MESSAGE:
+        *target = conn->message + conn->have;
+        return conn->segment - conn->have;
+    case CONN_KEY:
+        *target = conn->key + conn->have;
+        return conn->segment - conn->have;
+    default:
+        return 0;
+    }
+}
+
+
+/***********************************************************
+ * receive: advances the state machine after the driver
+ *          reads bytes into the connInput target.
+ *
+ * parameters: connection, number of bytes read.
+ * returns: 0 on success, -1 on protocol or memory error.
+ ***********************************************************/
+
+static int receive(struct connection *conn, size_t length) {
+    size_t i, capacity;
+    char *end, *grown;
+
+    switch (conn->state) {
+    case CONN_HANDSHAKE:
+        conn->handshakeLength += length;
+        if (memcmp(conn->handshake, V2_MAGIC, conn->handshakeLength < 4 ? conn->handshakeLength : 4) == 0) {    //v2, no handshake
+            return conn->handshakeLength < sizeof(conn->v2) ? 0 : startV2(conn);
+        }
+        end = memchr(conn->handshake, '\0', conn->handshakeLength);
+        if (end == NULL) {
+            if (conn->handshakeLength == sizeof(conn->handshake) - 1) {    //too long to be a handshake
+                reject(conn);
+            }
+            return 0;
+        }
+        if (end + 1 != conn->handshake + conn->handshakeLength) {    //clients wait for the confirmation before sending
+            reject(conn);
+            return 0;
+        }
+        return finishHandshake(conn);
+
+    case CONN_V2:
+        conn->length += length;
+        if (conn->length == conn->capacity) {
+            finishV2(conn);
+        }
+        return 0;
+
+    case CONN_PAD:
+        conn->padHave += length;
+        if (conn->padHave == sizeof(conn->request)) {
+            finishPadRequest(conn);
+        }
+        return 0;
+
+    case CONN_LEGACY:
+        for (i = conn->length; i < conn->length + length; i++) {    //search for newlines in the new bytes
+            if (conn->buffer[i] == '\n') {
+                conn->newlines++;
+                if (conn->newlines == 1) {    //first newline starts key
+                    conn->keyStart = i + 1;
+                } else {    //second newline is end of message
+                    conn->length = i;
+                    return finishLegacy(conn);
+                }
+            }
+        }
+        conn->length += length;
+        if (conn->length == conn->capacity) {
+            if (conn->capacity == LEGACY_BUFFER) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            capacity = conn->capacity * 2 < LEGACY_BUFFER ? conn->capacity * 2 : LEGACY_BUFFER;
+            grown = bufferResize(&conn->memory, conn->buffer, conn->capacity, capacity, conn->length);
+            if (grown == NULL) {
+                return -1;
+            }
+            conn->buffer = grown;
+            conn->capacity = capacity;
+        }
+        return 0;
+
+    case CONN_HEADER:
+        conn->have += length;
+        if (conn->have < sizeof(conn->header)) {
+            return 0;
+        }
+        conn->have = 0;
+        conn->segment = ntohl(conn->header);
+        conn->messageBytes += conn->segment;
+        if (conn->segment == 0) {    //end of a message
+            metricsMessage(conn->messageBytes);
+            conn->messageBytes = 0;
+        }
+        if (conn->segment == 0 && conn->persistent) {    //end of one message, the next header follows
+            conn->state = CONN_HEADER;
+            if (timeouts.request > 0) {    //every message gets the whole deadline
+                conn->requestAt = timerNow();
+            }
+        } else if (conn->segment == 0) {    //terminator, we're done
+            conn->state = CONN_CLOSING;
+        } else if (conn->segment > STREAM_SEGMENT) {
+            errno = EMSGSIZE;
+            return -1;
+        } else if (conn->pad != NULL && conn->segment > conn->padLength - conn->padPos) {    //past the claimed range
+            errno = EPROTO;
+            return -1;
+        } else {
+            conn->state = CONN_MESSAGE;
+        }
+        return 0;
+
+    case CONN_MESSAGE:
+        conn->have += length;
+        if (conn->have < conn->segment) {
+            return 0;
+        }
+        conn->have = 0;
+        if (conn->pad == NULL) {
+            conn->state = CONN_KEY;
+            return 0;
+        }
+        if (transform(conn, conn->message, conn->pad->data + conn->padStart + conn->padPos, conn->segment) < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        conn->padPos += conn->segment;
+        queueOutput(conn, conn->message, conn->segment);
+        conn->state = CONN_HEADER;
+        return 0;
+
+    case CONN_KEY:
+        conn->have += length;
+        if (conn->have == conn->segment) {    //whole segment here, transform and send it back
+            if (transform(conn, conn->message, conn->key, conn->segment) < 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            queueOutput(conn, conn->message, conn->segment);
+            conn->have = 0;
+            conn->state = CONN_HEADER;
+        }
+        return 0;
+
+    default:
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+
+/***********************************************************
+ * connReceived: advances the state machine after the driver
+ *               reads bytes into the connInput target, and
+ *               notes when the request is complete.
+ *
+ * parameters: connection, number of bytes read.
+ * returns: 0 on success, -1 on protocol or memory error.
+ ***********************************************************/
+
+int connReceived(struct connection *conn, size_t length) {
+    int result = receive(conn, length);
+
+    if (timeouts.idle > 0) {
+        conn->activeAt = timerNow();
+    }
+
+    if (conn->state == CONN_CLOSING && conn->receivedAt == 0 && conn->handshakeAt != 0) {
+        conn->receivedAt = metricsNow();
+        endPhase(conn, PHASE_RECEIVE, conn->handshakeAt, conn->receivedAt, 0);
+    }
+    return result;
+}
+
+
+/***********************************************************
+ * connHangup: handles the client closing its side. a
+ *             persistent connection may end between
+ *             messages; anywhere else it's cut short.
+ *
+ * parameters: connection.
+ * returns: 0 if the connection ended cleanly, -1 if not.
+ ***********************************************************/
+
+int connHangup(struct connection *conn) {
+    if (conn->persistent && conn->state == CONN_HEADER && conn->have == 0) {
+        conn->state = CONN_CLOSING;
+        conn->receivedAt = metricsNow();
+        endPhase(conn, PHASE_RECEIVE, conn->handshakeAt, conn->receivedAt, 0);
+        return 0;
+    }
+    errno = ECONNRESET;
+    return -1;
+}
+
+
+/***********************************************************
+ * connDeadline: works out when the connection runs out of
+ *               time: the handshake deadline while it's in
+ *               the handshake, the request deadline, or the
+ *               idle deadline, whichever comes first. it only
+ *               ever moves later, so drivers can check it
+ *               lazily when an old one comes due.
+ *
+ * parameters: connection.
+ * returns: deadline in timerNow milliseconds, 0 for none.
+ ***********************************************************/
+
+uint64_t connDeadline(const struct connection *conn) {
+    uint64_t deadline = 0;
+
+    if (conn->state == CONN_HANDSHAKE && timeouts.handshake > 0) {
+        deadline = conn->requestAt + timeouts.handshake;
+    }
+    if (timeouts.request > 0 && (deadline == 0 || conn->requestAt + timeouts.request < deadline)) {
+        deadline = conn->requestAt + timeouts.request;
+    }
+    if (timeouts.idle > 0 && (deadline == 0 || conn->activeAt + timeouts.idle < deadline)) {
+        deadline = conn->activeAt + timeouts.idle;
+    }
+    return deadline;
+}
+
+
+/***********************************************************
+ * connOutput: tells the driver what to send next.
+ *
+ * parameters: connection, pointer to receive the data.
+ * returns: number of bytes pending.
+ ***********************************************************/
+
+size_t connOutput(struct connection *conn, const char **data) {
+    if (conn->outPos == conn->outLength && conn->padding > 0) {
+        *data = legacyPadding;
+        return conn->padding < sizeof(legacyPadding) ? conn->padding : sizeof(legacyPadding);
+    }
+    *data = conn->out + conn->outPos;
+    return conn->outLength - conn->outPos;
+}
+
+
+/***********************************************************
+ * connSent: records bytes the driver managed to send.
+ *
+ * parameters: connection, number of bytes sent.
+ * returns: none.
+ ***********************************************************/
+
+void connSent(struct connection *conn, size_t length) {
+    if (timeouts.idle > 0) {
+        conn->activeAt = timerNow();
+    }
+    if (conn->outPos == conn->outLength) {    //only padding was offered
+        conn->padding -= length;
+        return;
+    }
+    conn->outPos += length;
+}
+
+
+/***********************************************************
+ * connDone: checks whether the connection can be closed.
+ *
+ * parameters: connection.
+ * returns: 1 if done, 0 if not.
+ ***********************************************************/
+
+int connDone(const struct connection *conn) {
+    return conn->state == CONN_CLOSING && conn->outPos == conn->outLength && conn->padding == 0;
+}
+
+
+/***********************************************************
+ * pumpConnection: moves bytes between the socket and the
+ *                 state machine until the connection is
+ *                 done, the socket would block, or the
+ *                 budget runs out.
+ *
+ * parameters: connection, max reads and writes (0 for no
+ *             limit).
+ * returns: 0 on success, -1 on error or early hang-up.
+ ***********************************************************/
+
+int pumpConnection(struct connection *conn, int budget) {
+    const char *data;
+    char *target;
+    size_t length;
+    ssize_t n;
+    int rounds = 0;
+
+    while (!connDone(conn)) {
+        if (budget > 0 && rounds++ == budget) {    //come back later, others are waiting
+            break;
+        }
+        length = connOutput(conn, &data);
+        if (length > 0) {    //always flush before reading more
+            n = write(conn->fd, data, length);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN ? 0 : -1;
+            }
+            connSent(conn, n);
+            metricsAdd(METRIC_BYTES_OUT, n);
+            continue;
+        }
+
+        length = connInput(conn, &target);
+        if (length == 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        n = read(conn->fd, target, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN ? 0 : -1;
+        }
+        if (n == 0) {    //client hung up
+            if (connHangup(conn) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        metricsAdd(METRIC_BYTES_IN, n);
+        if (connReceived(conn, n) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * listenTCP: opens a listening TCP socket.
+ *
+ * parameters: port, 1 to join the port's SO_REUSEPORT
+ *             group, server config.
+ * returns: listening socket.
+ ***********************************************************/
+
+static int listenTCP(int portNumber, int reusePort, const struct serverConfig *config) {
+    struct sockaddr_in serverAddress;
+    int listenSocketFD, optimumValue = 1;
+
+    memset((char *) &serverAddress, '\0', sizeof(serverAddress));    //clear out the address struct
+    serverAddress.sin_family = AF_INET;    //create a network-capable socket
+    serverAddress.sin_port = htons(portNumber);    //store the port number
+    serverAddress.sin_addr.s_addr = INADDR_ANY;    //any address is allowed for connection to this process
+
+    listenSocketFD = socket(AF_INET, SOCK_STREAM, 0);    //create the socket
+    if (listenSocketFD < 0)
+        fatal(config, "opening socket");
+    setsockopt(listenSocketFD, SOL_SOCKET, SO_REUSEADDR, &optimumValue, sizeof(int));    //allow reuse of port
+    if (reusePort && setsockopt(listenSocketFD, SOL_SOCKET, SO_REUSEPORT, &optimumValue, sizeof(int)) < 0)    //one queue per shard
+        fatal(config, "setting SO_REUSEPORT");
+
+    if (bind(listenSocketFD, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0)    //connect socket to port
+        fatal(config, "on binding");
+
+    listen(listenSocketFD, listenBacklog);    //turn socket on - it can now hold listenBacklog pending connections
+    return listenSocketFD;
+}
+
+
+/***********************************************************
+ * listenLocal: opens a listening Unix socket. a socket file
+ *              left behind by a daemon that is gone is
+ *              replaced; one that still answers is not.
+ *              who may connect is up to the permissions of
+ *              the file and its directory.
+ *
+ * parameters: socket path, server config.
+ * returns: listening socket.
+ ***********************************************************/
+
+static int listenLocal(const char *path, const struct serverConfig *config) {
+    struct sockaddr_storage serverAddress;
+    socklen_t addressLength;
+    int listenSocketFD, probe, stale;
+
+    if (endpointAddress(path, &serverAddress, &addressLength) < 0)
+        fatal(config, "socket path");
+    listenSocketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocketFD < 0)
+        fatal(config, "opening socket");
+
+    if (bind(listenSocketFD, (struct sockaddr *) &serverAddress, addressLength) < 0) {
+        if (errno != EADDRINUSE)
+            fatal(config, "on binding");
+        probe = socket(AF_UNIX, SOCK_STREAM, 0);    //is anyone still listening there?
+        stale = probe >= 0 && connect(probe, (struct sockaddr *) &serverAddress, addressLength) < 0 && errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+        errno = EADDRINUSE;
+        if (!stale || unlink(path) < 0 || bind(listenSocketFD, (struct sockaddr *) &serverAddress, addressLength) < 0)
+            fatal(config, "on binding");
+    }
+
+    listen(listenSocketFD, listenBacklog);
+    return listenSocketFD;
+}
+
+
+/***********************************************************
+ * listenOn: opens a listening socket for an endpoint.
+ *
+ * parameters: port or socket path, server config.
+ * returns: none.
+ ***********************************************************/
+
+static void listenOn(const char *endpoint, const struct serverConfig *config) {
+    listenFDs[listenCount++] = endpointIsPath(endpoint) ? listenLocal(endpoint, config) : listenTCP(atoi(endpoint), 0, config);
+}
+
+
+/***********************************************************
+ * listenShards: picks each shard's CPU from the ones this
+ *               process may run on and opens one
+ *               SO_REUSEPORT listener per shard. when shard
+ *               i sits on CPU i for every CPU, a classic BPF
+ *               program steers each connection to the shard
+ *               on the CPU that took its SYN; otherwise the
+ *               kernel's hash spreads them. a Unix socket
+ *               can't be split, so all shards share one.
+ *
+ * parameters: port or socket path, number of shards, server
+ *             config.
+ * returns: none.
+ ***********************************************************/
+
+static void listenShards(const char *endpoint, int shards, const struct serverConfig *config) {
+    struct sock_filter byCPU[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},    //CPU handling the SYN
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t) shards},
+        {BPF_RET | BPF_A, 0, 0, 0}                                   //index into the group, in bind order
+    };
+    struct sock_fprog program = {sizeof(byCPU) / sizeof(byCPU[0]), byCPU};
+    cpu_set_t allowed;
+    int cpu, count = 0, matched = 1, i;
+
+    shardCPUs = calloc(shards, sizeof(*shardCPUs));
+    if (shardCPUs == NULL)
+        fatal(config, "allocating shard table");
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        fatal(config, "reading CPU affinity");
+    for (cpu = 0; cpu < CPU_SETSIZE && count < shards; cpu++) {    //honors taskset
+        if (CPU_ISSET(cpu, &allowed))
+            shardCPUs[count++] = cpu;
+    }
+    for (i = count; i < shards; i++)    //more shards than CPUs doubles up
+        shardCPUs[i] = shardCPUs[i % count];
+
+    shardCount = shards;
+    if (endpointIsPath(endpoint)) {    //every shard accepts from the one socket
+        listenOn(endpoint, config);
+        return;
+    }
+    shardFDs = calloc(shards, sizeof(*shardFDs));
+    if (shardFDs == NULL)
+        fatal(config, "allocating shard table");
+    for (i = 0; i < shards; i++) {
+        shardFDs[i] = listenTCP(atoi(endpoint), 1, config);
+        matched &= shardCPUs[i] == i;
+    }
+    if (matched && count == CPU_COUNT(&allowed) &&
+        setsockopt(shardFDs[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+        fprintf(stderr, "%s: connections spread by hash, not CPU: %s\n", config->name, strerror(errno));
+}
+
+
+/***********************************************************
+ * acceptNext: accepts the next connection on any listening
+ *             socket. with more than one socket (or the
+ *             admin port) to watch it waits in poll and
+ *             answers metrics scrapes while it's there.
+ *
+ * parameters: accept4 flags.
+ * returns: connected socket, -1 on error.
+ ***********************************************************/
+
+static int acceptNext(int flags) {
+    struct pollfd fds[LISTEN_MAX + 1];
+    int fd, i;
+
+    if (!listenPolled) {    //one socket, accept blocks on it
+        return accept4(listenFDs[0], NULL, NULL, flags);
+    }
+    while (1) {
+        for (i = 0; i < listenCount; i++)
+            fds[i] = (struct pollfd) {listenFDs[i], POLLIN, 0};
+        fds[listenCount] = (struct pollfd) {adminSocketFD, POLLIN, 0};    //poll skips it when it's -1
+        if (poll(fds, listenCount + 1, -1) < 0)
+            return -1;
+        if (fds[listenCount].revents & POLLIN)
+            metricsServe(adminSocketFD);
+        for (i = 0; i < listenCount; i++) {
+            if (fds[i].revents == 0)
+                continue;
+            fd = accept4(listenFDs[i], NULL, NULL, flags);
+            if (fd >= 0 || errno != EAGAIN)    //EAGAIN: another worker got there first
+                return fd;
+        }
+    }
+}
+
+
+/***********************************************************
+ * closeListeners: closes every listening socket, for
+ *                 children that don't accept.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void closeListeners(void) {
+    int i;
+
+    for (i = 0; i < listenCount; i++)
+        close(listenFDs[i]);
+}
+
+
+/***********************************************************
+ * reapChildren: SIGCHLD handler for the fork mode.
+ *
+ * parameters: signal number.
+ * returns: none.
+ ***********************************************************/
+
+static void reapChildren(int signo) {
+    int savedErrno = errno;
+    pid_t pid;
+    (void) signo;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {    //reap every child that has finished
+        metricsWorkers(-1);
+        bufferReap(pid);
+    }
+    errno = savedErrno;
+}
+
+
+/***********************************************************
+ * waitReadable: waits until a descriptor is readable,
+ *               answering metrics scrapes in the meantime.
+ *
+ * parameters: descriptor.
+ * returns: none.
+ ***********************************************************/
+
+static void waitReadable(int fd) {
+    struct pollfd fds[2];
+
+    if (adminSocketFD < 0) {    //nothing else to watch, the caller blocks instead
+        return;
+    }
+    while (1) {
+        fds[0] = (struct pollfd) {fd, POLLIN, 0};
+        fds[1] = (struct pollfd) {adminSocketFD, POLLIN, 0};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return;    //let the caller's own call report it
+        }
+        if (fds[1].revents & POLLIN)
+            metricsServe(adminSocketFD);
+        if (fds[0].revents)
+            return;
+    }
+}
+
+
+/***********************************************************
+ * serveBlocking: serves a process's only connection. with
+ *                deadlines the socket is made non-blocking
+ *                and poll waits out whatever time is left,
+ *                otherwise reads and writes just block.
+ *
+ * parameters: connection.
+ * returns: 0 on success, -1 on error, early hang-up or a
+ *          missed deadline (ETIMEDOUT).
+ ***********************************************************/
+
+static int serveBlocking(struct connection *conn) {
+    struct pollfd fds;
+    const char *data;
+    uint64_t deadline, now;
+
+    if (connDeadline(conn) == 0) {
+        return pumpConnection(conn, 0);
+    }
+    fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+    while (pumpConnection(conn, 0) == 0) {    //returns when done or when the socket would block
+        if (connDone(conn)) {
+            return 0;
+        }
+        deadline = connDeadline(conn);
+        now = timerNow();
+        if (deadline != 0 && deadline <= now) {
+            metricsAdd(METRIC_TIMED_OUT, 1);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        fds = (struct pollfd) {conn->fd, connOutput(conn, &data) > 0 ? POLLOUT : POLLIN, 0};
+        if (poll(&fds, 1, deadline != 0 ? (int) (deadline - now) : -1) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+
+/***********************************************************
+ * serveFork: forks a child for every connection. children
+ *            are reaped from SIGCHLD, so the accept loop
+ *            never waits on them.
+ *
+ * parameters: server config.
+ * returns: none.
+ ***********************************************************/
+
+static void serveFork(const struct serverConfig *config) {
+    struct connection conn;
+    struct sigaction action;
+    int establishedConnectionFD;
+    uint64_t acceptedAt;
+    pid_t pid;
+
+    memset(&action, '\0', sizeof(action));
+    action.sa_handler = reapChildren;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, NULL);
+
+    while (1) {
+        establishedConnectionFD = acceptNext(0);
+        if (establishedConnectionFD < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fatal(config, "on accept");
+        }
+
+        acceptedAt = metricsNow();
+        pid = fork();    //fork child process
+        if (pid < 0)
+            fatal(config, "forking process");
+
+        if (pid == 0) {    //child will handle connection
+            closeListeners();
+            if (adminSocketFD >= 0)
+                close(adminSocketFD);
+            connInit(&conn, establishedConnectionFD, config);
+            traceSpan(conn.traceId, TRACE_FORK, acceptedAt, conn.acceptedAt, 0);
+            if (serveBlocking(&conn) < 0) {
+                connFree(&conn);
+                fatal(config, "serving connection");
+            }
+            connFree(&conn);
+            _Exit(0);
+        }
+        metricsWorkers(1);    //one child per connection
+        close(establishedConnectionFD);    //close the existing socket which is connected to the client
+    }
+}
+
+
+/***********************************************************
+ * workerLoop: body of a pre-forked worker. accepts from the
+ *             shared listening sockets and serves one
+ *             connection at a time, forever.
+ *
+ * parameters: server config.
+ * returns: none.
+ ***********************************************************/
+
+static void workerLoop(const struct serverConfig *config) {
+    struct connection conn;
+    int establishedConnectionFD;
+
+    while (1) {
+        establishedConnectionFD = acceptNext(0);    //the kernel wakes one waiting worker
+        if (establishedConnectionFD < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fatal(config, "on accept");    //the supervisor will start a new worker
+        }
+        connInit(&conn, establishedConnectionFD, config);
+        if (serveBlocking(&conn) < 0)
+            fprintf(stderr, "%s: ERROR serving connection: %s\n", config->name, strerror(errno));
+        connFree(&conn);
+        close(establishedConnectionFD);
+    }
+}
+
+
+static void serveEpoll(const struct serverConfig *config);
+
+
+/***********************************************************
+ * runShard: body of a shard worker. pins itself to the
+ *           shard's CPU, keeps only the shard's listener
+ *           (and any Unix socket, which all shards share)
+ *           and runs the event loop there. memory it touches
+ *           from then on comes from that CPU's NUMA node
+ *           under the default local allocation policy.
+ *
+ * parameters: shard number, server config.
+ * returns: none.
+ ***********************************************************/
+
+static void runShard(int shard, const struct serverConfig *config) {
+    cpu_set_t pinned;
+    int i;
+
+    CPU_ZERO(&pinned);
+    CPU_SET(shardCPUs[shard], &pinned);
+    if (sched_setaffinity(0, sizeof(pinned), &pinned) < 0)
+        fatal(config, "pinning shard");
+    for (i = 0; shardFDs != NULL && i < shardCount; i++) {
+        if (i != shard)
+            close(shardFDs[i]);
+    }
+    if (shardFDs != NULL)    //a Unix endpoint is already in listenFDs
+        listenFDs[listenCount++] = shardFDs[shard];
+    parallelOpen(1, PARALLEL_THRESHOLD);    //every CPU already has a shard
+    serveEpoll(config);
+}
+
+
+/***********************************************************
+ * spawnWorker: forks one pre-forked worker.
+ *
+ * parameters: signalfd to close in the child, signals to
+ *             unblock in the child, shard to run (-1 for a
+ *             plain worker), server config.
+ * returns: worker pid.
+ ***********************************************************/
+
+static pid_t spawnWorker(int signalFD, const sigset_t *mask, int shard, const struct serverConfig *config) {
+    pid_t pid = fork();
+
+    if (pid < 0)
+        fatal(config, "forking worker");
+    if (pid == 0) {
+        close(signalFD);
+        if (adminSocketFD >= 0)
+            close(adminSocketFD);
+        adminSocketFD = -1;    //scrapes are the supervisor's
+        sigprocmask(SIG_UNBLOCK, mask, NULL);    //workers die normally on SIGTERM
+        if (shard >= 0)
+            runShard(shard, config);
+        else
+            workerLoop(config);
+        _Exit(1);
+    }
+    metricsWorkers(1);
+    return pid;
+}
+
+
+/***********************************************************
+ * servePrefork: supervises a fixed pool of long-lived
+ *               workers sharing the listening socket, or one
+ *               shard per listener when sharding. the
+ *               supervisor sleeps on a signalfd, reaps
+ *               workers that exit and starts replacements.
+ *
+ * parameters: number of workers, server config.
+ * returns: none.
+ ***********************************************************/
+
+static void servePrefork(int workers, const struct serverConfig *config) {
+    struct signalfd_siginfo info;
+    sigset_t mask;
+    pid_t *pids, pid;
+    time_t *started;
+    int signalFD, status, i;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, NULL);    //only delivered through the signalfd from here on
+    signalFD = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signalFD < 0)
+        fatal(config, "creating signalfd");
+
+    pids = calloc(workers, sizeof(*pids));
+    started = calloc(workers, sizeof(*started));
+    if (pids == NULL || started == NULL)
+        fatal(config, "allocating worker table");
+    for (i = 0; i < workers; i++) {
+        pids[i] = spawnWorker(signalFD, &mask, shardCount > 0 ? i : -1, config);
+        started[i] = time(NULL);
+    }
+
+    while (1) {
+        waitReadable(signalFD);    //scrapes are answered from here too
+        if (read(signalFD, &info, sizeof(info)) != sizeof(info)) {    //idle here until a signal arrives
+            if (errno == EINTR)
+                continue;
+            fatal(config, "reading signalfd");
+        }
+
+        if (info.ssi_signo != SIGCHLD) {    //shutting down, take the workers with us
+            for (i = 0; i < workers; i++)
+                kill(pids[i], SIGTERM);
+            while (wait(NULL) > 0)
+                ;
+            exit(0);
+        }
+
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {    //one signal can stand for several exits
+            bufferReap(pid);    //a killed worker can't give its buffers back itself
+            for (i = 0; i < workers && pids[i] != pid; i++)
+                ;
+            if (i == workers)
+                continue;
+            metricsWorkers(-1);
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "%s: worker %d killed by signal %d, restarting\n", config->name, (int) pid, WTERMSIG(status));
+            else
+                fprintf(stderr, "%s: worker %d exited with status %d, restarting\n", config->name, (int) pid, WEXITSTATUS(status));
+            if (time(NULL) - started[i] < 1)    //don't spin if workers die right away
+                sleep(1);
+            pids[i] = spawnWorker(signalFD, &mask, shardCount > 0 ? i : -1, config);    //a shard comes back on its own CPU and listener
+            started[i] = time(NULL);
+        }
+    }
+}
+
+
+/***********************************************************
+ * closeConnection: drops a connection from the event loop.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void closeConnection(struct connection *conn) {
+    timerCancel(&connTimers, &conn->timer);
+    close(conn->fd);    //also removes it from the epoll set
+    connFree(conn);
+    free(conn);
+}
+
+
+/***********************************************************
+ * acceptAll: accepts every pending connection and registers
+ *            it with the event loop.
+ *
+ * parameters: epoll fd, listening socket, server config.
+ * returns: none.
+ ***********************************************************/
+
+static void acceptAll(int epollFD, int listenSocketFD, const struct serverConfig *config) {
+    struct epoll_event event;
+    struct connection *conn;
+    int fd;
+
+    while (1) {
+        fd = accept4(listenSocketFD, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "%s: ERROR on accept: %s\n", config->name, strerror(errno));
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        conn = malloc(sizeof(*conn));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        connInit(conn, fd, config);
+        conn->events = EPOLLIN;
+        event.events = conn->events;
+        event.data.ptr = conn;
+        if (epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &event) < 0) {
+            closeConnection(conn);
+            continue;
+        }
+        if (connDeadline(conn) != 0) {
+            timerSchedule(&connTimers, &conn->timer, connDeadline(conn));
+        }
+    }
+}
+
+
+/***********************************************************
+ * expireConnections: closes connections whose deadline has
+ *                    passed. reads and writes never touch
+ *                    the wheel, so an entry that comes due
+ *                    for a connection that has since moved
+ *                    its deadline is just put back.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void expireConnections(void) {
+    struct timerEntry *entry, *next;
+    struct connection *conn;
+    uint64_t now = timerNow(), deadline;
+
+    for (entry = timerExpire(&connTimers, now); entry != NULL; entry = next) {
+        next = entry->next;
+        conn = (struct connection *) ((char *) entry - offsetof(struct connection, timer));
+        deadline = connDeadline(conn);
+        if (deadline > now) {
+            timerSchedule(&connTimers, entry, deadline);
+        } else {
+            metricsAdd(METRIC_TIMED_OUT, 1);
+            closeConnection(conn);
+        }
+    }
+}
+
+
+/***********************************************************
+ * serveEpoll: serves every connection from one process with
+ *             a non-blocking event loop.
+ *
+ * parameters: server config.
+ * returns: none.
+ ***********************************************************/
+
+static void serveEpoll(const struct serverConfig *config) {
+    struct epoll_event events[EPOLL_EVENTS], event;
+    struct connection *conn;
+    const char *data;
+    int epollFD, ready, i;
+
+    epollFD = epoll_create1(0);
+    if (epollFD < 0)
+        fatal(config, "creating epoll instance");
+    for (i = 0; i < listenCount; i++) {
+        fcntl(listenFDs[i], F_SETFL, fcntl(listenFDs[i], F_GETFL) | O_NONBLOCK);
+        event.events = EPOLLIN;
+        event.data.ptr = &listenFDs[i];    //points into the listener table
+        if (epoll_ctl(epollFD, EPOLL_CTL_ADD, listenFDs[i], &event) < 0)
+            fatal(config, "watching listening socket");
+    }
+    event.data.ptr = &adminMarker;
+    if (adminSocketFD >= 0 && epoll_ctl(epollFD, EPOLL_CTL_ADD, adminSocketFD, &event) < 0)
+        fatal(config, "watching admin socket");
+    timerInit(&connTimers, timerNow());
+
+    while (1) {
+        ready = epoll_wait(epollFD, events, EPOLL_EVENTS, timerTimeout(&connTimers, timerNow()));    //sleep until the wheel has to move
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            fatal(config, "waiting for events");
+        }
+        for (i = 0; i < ready; i++) {
+            conn = events[i].data.ptr;
+            if ((int *) conn >= listenFDs && (int *) conn < listenFDs + listenCount) {
+                acceptAll(epollFD, *(int *) conn, config);
+                continue;
+            }
+            if (conn == (struct connection *) &adminMarker) {
+                metricsServe(adminSocketFD);
+                continue;
+            }
+            if (pumpConnection(conn, EPOLL_BUDGET) < 0 || connDone(conn)) {
+                closeConnection(conn);
+                continue;
+            }
+            event.events = connOutput(conn, &data) > 0 ? EPOLLOUT : EPOLLIN;    //wait for whichever side is blocked
+            if (event.events != conn->events) {
+                event.data.ptr = conn;
+                conn->events = event.events;
+                epoll_ctl(epollFD, EPOLL_CTL_MOD, conn->fd, &event);
+            }
+        }
+        expireConnections();    //after the batch, nothing left in it can point at a closed connection
+    }
+}
+
+
+/***********************************************************
+ * parseSize: reads a byte count with an optional k, m or g
+ *            suffix.
+ *
+ * parameters: text.
+ * returns: bytes, 0 if the text isn't a size.
+ ***********************************************************/
+
+static size_t parseSize(const char *text) {
+    char *end;
+    unsigned long long size = strtoull(text, &end, 10);
+    int shift = 0;
+
+    if (end == text || *text == '-') {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        shift = 10;
+    } else if (*end == 'm' || *end == 'M') {
+        shift = 20;
+    } else if (*end == 'g' || *end == 'G') {
+        shift = 30;
+    }
+    if ((shift > 0 ? end[1] : end[0]) != '\0' || size > (SIZE_MAX >> shift)) {
+        return 0;
+    }
+    return (size_t) size << shift;
+}
+
+
+/***********************************************************
+ * parseDuration: reads a time with an optional ms, s or m
+ *                suffix; a bare number is seconds.
+ *
+ * parameters: text.
+ * returns: milliseconds, -1 if the text isn't a time.
+ ***********************************************************/
+
+static long long parseDuration(const char *text) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    long long scale = 1000;
+
+    if (end == text || *text == '-') {
+        return -1;
+    }
+    if (strcmp(end, "ms") == 0) {
+        scale = 1;
+    } else if (strcmp(end, "m") == 0) {
+        scale = 60000;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return -1;
+    }
+    if (value > UINT32_MAX) {    //keeps the deadlines far from overflowing
+        return -1;
+    }
+    return (long long) value * scale;
+}
+
+
+/***********************************************************
+ * serverMain: parses the daemon's arguments and runs the
+ *             chosen server mode.
+ *
+ * parameters: number of arguments, argument array, server
+ *             config.
+ * returns: exit status.
+ ***********************************************************/
+
+int serverMain(int argc, char *argv[], const struct serverConfig *config) {
+    int opt, mode = SERVER_FORK, workers = sysconf(_SC_NPROCESSORS_ONLN), threads = workers, i;
+    int adminPort = 0;
+    size_t memoryLimit = 0, connectionBudget = 0;
+    const char *kernel = NULL, *padDirectory = NULL, *socketPath = NULL, *tracePath = NULL;
+    const struct cipherKernel *selected;
+
+    while ((opt = getopt(argc, argv, "m:w:k:p:a:u:t:b:M:C:T:H:I:R:")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "fork") == 0) {
+            mode = SERVER_FORK;
+        } else if (opt == 'm' && strcmp(optarg, "epoll") == 0) {
+            mode = SERVER_EPOLL;
+        } else if (opt == 'm' && strcmp(optarg, "prefork") == 0) {
+            mode = SERVER_PREFORK;
+        } else if (opt == 'm' && strcmp(optarg, "uring") == 0) {
+            mode = SERVER_URING;
+        } else if (opt == 'm' && strcmp(optarg, "shard") == 0) {
+            mode = SERVER_SHARD;
+        } else if (opt == 'b' && atoi(optarg) > 0) {
+            listenBacklog = atoi(optarg);    //capped by net.core.somaxconn
+        } else if (opt == 'M' && parseSize(optarg) > 0) {
+            memoryLimit = parseSize(optarg);    //buffer bytes across every worker
+        } else if (opt == 'C' && parseSize(optarg) > 0) {
+            connectionBudget = parseSize(optarg);    //buffer bytes for any one connection
+        } else if (opt == 'H' && parseDuration(optarg) >= 0) {
+            timeouts.handshake = parseDuration(optarg);    //time to send the handshake, 0 for no limit
+        } else if (opt == 'I' && parseDuration(optarg) >= 0) {
+            timeouts.idle = parseDuration(optarg);    //time a client may go without sending or taking a byte
+        } else if (opt == 'R' && parseDuration(optarg) >= 0) {
+            timeouts.request = parseDuration(optarg);    //time for a whole request, per message on persistent connections
+        } else if (opt == 'w' && atoi(optarg) > 0) {
+            workers = atoi(optarg);    //size of the pre-forked pool
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            threads = atoi(optarg);    //threads per process for messages over the threshold, 1 for none
+        } else if (opt == 'k') {
+            kernel = optarg;    //force a cipher kernel instead of the best one for this CPU
+        } else if (opt == 'T') {
+            tracePath = optarg;    //record every request's phases in a ring in this file
+        } else if (opt == 'p') {
+            padDirectory = optarg;    //serve keys from the pads in this directory
+        } else if (opt == 'a' && atoi(optarg) > 0) {
+            adminPort = atoi(optarg);    //serve metrics on this loopback port
+        } else if (opt == 'u' && endpointIsPath(optarg)) {
+            socketPath = optarg;    //Unix socket for clients on this host, as well as the port
+        } else {
+            optind = argc;    //force the usage message
+            break;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: %s [-m fork|prefork|epoll|uring|shard] [-w workers] [-k kernel] [-p paddir] [-a adminport] [-u socketpath] [-t threads] [-b backlog] [-M memory] [-C connmemory] [-T tracefile] [-H handshake] [-I idle] [-R request] <port|socketpath>\n", argv[0]);    //check usage & args
+        exit(1);
+    }
+
+    selected = cipherSelect(kernel);
+    if (selected == NULL) {    //pick once, before any workers fork
+        fprintf(stderr, "%s: ERROR cipher kernel %s is not available\n", config->name, kernel);
+        exit(1);
+    }
+    if (padDirectory != NULL && (padsLoaded = padOpen(padDirectory)) < 0)    //mapped before forking so workers share the ledgers
+        fatal(config, "loading pads");
+    if (adminPort > 0) {    //counter page is mapped before forking so every worker adds to it
+        if (metricsOpen(config->name, selected->name) < 0)
+            fatal(config, "mapping metrics");
+        adminSocketFD = metricsListen(adminPort);
+        if (adminSocketFD < 0)
+            fatal(config, "opening admin port");
+    }
+    if (tracePath != NULL && traceOpen(tracePath) < 0)    //the ring is mapped before forking too
+        fatal(config, "opening trace file");
+    if (bufferOpen(memoryLimit, connectionBudget) < 0)    //the cap's page is shared like the counter page
+        fatal(config, "mapping buffer budget");
+    parallelOpen(threads, PARALLEL_THRESHOLD);    //threads start in whichever process first needs them
+    signal(SIGPIPE, SIG_IGN);    //a client hanging up mid-write is an error, not a reason to die
+    if (mode == SERVER_SHARD)
+        listenShards(argv[optind], workers > 0 ? workers : 1, config);    //each shard adds its own port listener to listenFDs
+    else
+        listenOn(argv[optind], config);
+    if (socketPath != NULL)
+        listenOn(socketPath, config);
+    listenPolled = listenCount > 1 || adminSocketFD >= 0;
+    for (i = 0; listenPolled && i < listenCount; i++)    //woken by poll, so accept mustn't block if another worker won
+        fcntl(listenFDs[i], F_SETFL, fcntl(listenFDs[i], F_GETFL) | O_NONBLOCK);
+
+    if (mode == SERVER_URING && serveUring(listenFDs, listenCount, adminSocketFD, config) < 0) {    //only returns if the kernel can't
+        fprintf(stderr, "%s: io_uring is not available (%s), using epoll\n", config->name, strerror(errno));
+        mode = SERVER_EPOLL;
+    }
+    if (mode == SERVER_EPOLL) {
+        metricsWorkers(1);    //this process is the only worker
+        serveEpoll(config);
+    } else if (mode == SERVER_PREFORK || mode == SERVER_SHARD) {
+        servePrefork(workers > 0 ? workers : 1, config);
+    } else {
+        serveFork(config);
+    }
+    closeListeners();    //close the listening sockets
+    return 0;
+}
@@ -0,0 +1,105 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_server.h
+ *
+ * Overview:
+ * Daemon core shared by otp_enc_d, otp_dec_d and otp_d. Each
+ * connection is a small state machine (handshake, receive,
+ * transform, send) that never touches the socket itself, so
+ * the same protocol code runs under every server mode.
+ ************************************************************/
+
+#ifndef OTP_SERVER_H
+#define OTP_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_stream.h"
+#include "otp_pad.h"
+#include "otp_timer.h"
+
+#define LEGACY_BUFFER 100000    //legacy protocol input limit and response size
+
+struct serviceConfig {
+    const char *handshake;    //legacy handshake, e.g. "enc_bs"; suffixes pick the other protocols
+    const char *response;     //authority confirmation, e.g. "enc_d_bs"
+    int decrypting;           //1 to run the alphabet's decrypt, 0 for encrypt
+};
+
+struct serverConfig {
+    const char *name;                        //prefix for error messages
+    const struct serviceConfig *services;    //handshakes this daemon answers
+    int serviceCount;
+};
+
+extern const struct serviceConfig cipherServices[];    //encrypt, then decrypt
+
+enum connState {
+    CONN_HANDSHAKE,    //waiting for the NUL-terminated handshake
+    CONN_PAD,          //reading the pad request
+    CONN_LEGACY,       //reading message and key up to the second newline
+    CONN_V2,           //reading a v2 message and key
+    CONN_HEADER,       //reading a stream segment length
+    CONN_MESSAGE,      //reading a stream message segment
+    CONN_KEY,          //reading a stream key segment
+    CONN_CLOSING       //flushing the last output, then done
+};
+
+struct connection {
+    int fd;
+    const struct serverConfig *config;
+    const struct serviceConfig *service;    //picked by the handshake
+    segmentTransform transform;
+    enum connState state;
+    int persistent;             //more than one message per connection
+    uint32_t events;            //epoll interest currently registered
+
+    char handshake[32];         //also holds the start of a v2 request
+    size_t handshakeLength;
+    struct v2Header v2;
+
+    char *buffer;               //legacy message and key
+    size_t length, capacity;
+    size_t keyStart;
+    int newlines;
+
+    uint32_t header;            //stream segment being received
+    size_t segment, have;
+    char *message, *key;
+
+    struct padRequest request;  //key comes from a pad on the server instead
+    size_t padHave;
+    struct pad *pad;
+    uint64_t padStart, padLength, padPos;
+    uint64_t padReply;
+
+    const char *out;            //pending output
+    size_t outLength, outPos;
+    size_t padding;             //NULs still owed after the output, legacy only
+
+    size_t memory;              //buffer bytes charged to this connection
+
+    uint64_t acceptedAt, handshakeAt, receivedAt;    //phase timestamps, 0 when metrics are off
+    uint64_t messageBytes;      //stream message received so far
+    uint32_t traceId;           //request number in the trace ring, 0 when tracing is off
+
+    uint64_t requestAt;         //accept, or the end of a persistent connection's last message; timerNow milliseconds
+    uint64_t activeAt;          //last byte moved, kept only with an idle timeout
+    struct timerEntry timer;    //in the event loop's wheel
+};
+
+void connInit(struct connection *conn, int fd, const struct serverConfig *config);
+void connFree(struct connection *conn);
+size_t connInput(struct connection *conn, char **target);
+int connReceived(struct connection *conn, size_t length);
+size_t connOutput(struct connection *conn, const char **data);
+void connSent(struct connection *conn, size_t length);
+int connDone(const struct connection *conn);
+int connHangup(struct connection *conn);
+uint64_t connDeadline(const struct connection *conn);
+int pumpConnection(struct connection *conn, int budget);
+
+int serverMain(int argc, char *argv[], const struct serverConfig *config);
+
+#endif
@@ -0,0 +1,350 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_stream.c
+ *
+ * Overview:
+ * Segmented streaming protocol shared by the clients and
+ * the daemons.
+ ************************************************************/
+
+#define _GNU_SOURCE    //splice
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "otp_cipher.h"
+#include "otp_stream.h"
+
+
+/***********************************************************
+ * endpointIsPath: tells a Unix socket path from a port.
+ *
+ * parameters: endpoint.
+ * returns: 1 for a socket path, 0 for a port.
+ ***********************************************************/
+
+int endpointIsPath(const char *endpoint) {
+    return strchr(endpoint, '/') != NULL;    //"./otp.sock" rather than "otp.sock"
+}
+
+
+/***********************************************************
+ * endpointAddress: builds the address of a daemon: a Unix
+ *                  socket for a path, loopback TCP for a bare
+ *                  port, and the named host for host:port
+ *                  ([addr]:port for IPv6).
+ *
+ * parameters: endpoint, address out, address length out.
+ * returns: 0 on success, -1 if the path is too long or the
+ *          host can't be resolved.
+ ***********************************************************/
+
+int endpointAddress(const char *endpoint, struct sockaddr_storage *address, socklen_t *length) {
+    struct sockaddr_un *local = (struct sockaddr_un *) address;
+    struct sockaddr_in *inet = (struct sockaddr_in *) address;
+    struct addrinfo hints, *found;
+    const char *colon = strrchr(endpoint, ':');
+    char host[256];
+    size_t hostLength;
+
+    memset(address, '\0', sizeof(*address));
+    if (endpointIsPath(endpoint)) {
+        if (strlen(endpoint) >= sizeof(local->sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        local->sun_family = AF_UNIX;
+        strcpy(local->sun_path, endpoint);
+        *length = sizeof(*local);
+        return 0;
+    }
+    if (colon != NULL) {
+        hostLength = colon - endpoint;
+        if (hostLength >= 2 && endpoint[0] == '[' && endpoint[hostLength - 1] == ']') {    //[::1]:5701
+            endpoint++;
+            hostLength -= 2;
+        }
+        if (hostLength == 0 || hostLength >= sizeof(host)) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(host, endpoint, hostLength);
+        host[hostLength] = '\0';
+        memset(&hints, '\0', sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, colon + 1, &hints, &found) != 0) {
+            errno = EHOSTUNREACH;
+            return -1;
+        }
+        memcpy(address, found->ai_addr, found->ai_addrlen);    //first answer, the resolver already sorted them
+        *length = found->ai_addrlen;
+        freeaddrinfo(found);
+        return 0;
+    }
+    inet->sin_family = AF_INET;
+    inet->sin_port = htons(atoi(endpoint));
+    inet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    *length = sizeof(*inet);
+    return 0;
+}
+
+
+/***********************************************************
+ * readFull: reads until length bytes arrive or the peer
+ *           closes.
+ *
+ * parameters: file descriptor, buffer, length.
+ * returns: bytes read (short on end of file), -1 on error.
+ ***********************************************************/
+
+ssize_t readFull(int fd, void *buffer, size_t length) {
+    char *p = buffer;
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < length) {
+        n = read(fd, p + total, length - total);
+        if (n == 0) {    //peer closed
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+
+/***********************************************************
+ * writeFull: writes all length bytes.
+ *
+ * parameters: file descriptor, buffer, length.
+ * returns: length, -1 on error.
+ ***********************************************************/
+
+ssize_t writeFull(int fd, const void *buffer, size_t length) {
+    const char *p = buffer;
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < length) {
+        n = write(fd, p + total, length - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+
+/***********************************************************
+ * writeVector: writes every buffer of an iovec array,
+ *              picking up after short writes. the array is
+ *              used up in the process.
+ *
+ * parameters: file descriptor, iovec array, count.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+int writeVector(int fd, struct iovec *iov, int count) {
+    ssize_t n;
+
+    while (count > 0) {
+        n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {    //skip what went out
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+
+/***********************************************************
+ * forwardOutput: moves up to length bytes that have arrived
+ *                on the socket to outfd. pipes and regular
+ *                files get them through splice, so the bytes
+ *                never enter user space; anything else falls
+ *                back to read and write.
+ *
+ * parameters: socket, output fd, max bytes to move.
+ * returns: bytes moved, 0 at end of stream, -1 on error
+ *          (EAGAIN if the socket is non-blocking and empty).
+ ***********************************************************/
+
+ssize_t forwardOutput(int sockfd, int outfd, size_t length) {
+    static int mode = -1;    //0 read and write, 1 splice straight to a pipe, 2 splice through our own pipe
+    static int pipefd[2];
+    static char buffer[STREAM_SEGMENT];
+    struct stat info;
+    ssize_t n, moved, m;
+
+    if (mode < 0) {    //decide once per process
+        mode = 0;
+        if (fstat(outfd, &info) == 0 && S_ISFIFO(info.st_mode)) {
+            mode = 1;
+        } else if (fstat(outfd, &info) == 0 && S_ISREG(info.st_mode) && !(fcntl(outfd, F_GETFL) & O_APPEND) &&
+                   pipe(pipefd) == 0) {
+            mode = 2;
+        }
+    }
+
+    if (mode == 0) {
+        n = read(sockfd, buffer, length < sizeof(buffer) ? length : sizeof(buffer));
+        if (n > 0 && writeFull(outfd, buffer, n) < 0) {
+            return -1;
+        }
+        return n;
+    }
+    if (mode == 1) {
+        return splice(sockfd, NULL, outfd, NULL, length < STREAM_SEGMENT ? length : STREAM_SEGMENT, SPLICE_F_MOVE);
+    }
+
+    n = splice(sockfd, NULL, pipefd[1], NULL, length < STREAM_SEGMENT ? length : STREAM_SEGMENT, SPLICE_F_MOVE);
+    for (moved = 0; n > 0 && moved < n; moved += m) {    //drain our pipe before taking more
+        m = splice(pipefd[0], NULL, outfd, NULL, n - moved, SPLICE_F_MOVE);
+        if (m <= 0) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+
+/***********************************************************
+ * segmentVector: points an iovec at the unsent part of a
+ *                segment, so header, message and key go out
+ *                in one writev without being copied.
+ *
+ * parameters: iovec array of 3, header, message, key (NULL
+ *             when the daemon holds it), segment length,
+ *             bytes already sent.
+ * returns: number of iovec entries used.
+ ***********************************************************/
+
+int segmentVector(struct iovec *iov, const uint32_t *header, const char *message, const char *key,
+                  size_t segment, size_t sent) {
+    const char *parts[3] = {(const char *) header, message, key};
+    size_t lengths[3] = {sizeof(*header), segment, key != NULL ? segment : 0};
+    int i, count = 0;
+
+    for (i = 0; i < 3; i++) {
+        if (sent >= lengths[i]) {
+            sent -= lengths[i];
+            continue;
+        }
+        iov[count].iov_base = (void *) (parts[i] + sent);
+        iov[count].iov_len = lengths[i] - sent;
+        sent = 0;
+        count++;
+    }
+    return count;
+}
+
+
+/***********************************************************
+ * sendStream: client side of the streaming protocol. sends
+ *             the message and key straight from memory
+ *             (normally mmapped files) while forwarding the
+ *             results to outfd as they come back.
+ *
+ * parameters: connected socket, message, key (NULL when
+ *             the daemon has it in a pad), message length,
+ *             alphabet to validate the message against (NULL
+ *             to skip), fd to write results to.
+ * returns: 0 on success, -1 on I/O error, -2 if the message
+ *          contains invalid characters.
+ ***********************************************************/
+
+int sendStream(int sockfd, const char *message, const char *key, long length, const struct cipherAlphabet *validate, int outfd) {
+    struct iovec iov[3];
+    struct pollfd pfd;
+    uint32_t header = 0;
+    size_t segment = 0, outLength = 0, outPos = 0;
+    long start = 0, received = 0;
+    int finished = 0;    //terminator has been queued
+    ssize_t n;
+
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);    //never block writing while the daemon writes back
+    pfd.fd = sockfd;
+
+    while (1) {
+        if (outPos == outLength && !finished) {    //queue the next segment
+            start += segment;
+            segment = length - start < STREAM_SEGMENT ? length - start : STREAM_SEGMENT;
+            if (validate != NULL && !cipherValid(validate, message + start, segment)) {    //checked on the way out
+                return -2;
+            }
+            header = htonl(segment);
+            outLength = sizeof(header) + (key != NULL ? 2 : 1) * segment;
+            outPos = 0;
+            finished = (segment == 0);
+        }
+
+        pfd.events = POLLIN | (outPos < outLength ? POLLOUT : 0);
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (pfd.revents & POLLOUT) {
+            n = writev(sockfd, iov, segmentVector(iov, &header, message + start, key != NULL ? key + start : NULL, segment, outPos));
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                return -1;
+            }
+            if (n > 0) {
+                outPos += n;
+            }
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            n = forwardOutput(sockfd, outfd, length - received > 0 ? length - received : 1);
+            if (n == 0) {    //daemon closed after the terminator
+                break;
+            }
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            received += n;
+        }
+    }
+    if (received != length) {    //daemon gave up on the message
+        errno = EPROTO;
+        return -1;
+    }
+    return finished && outPos == outLength ? 0 : -1;
+}
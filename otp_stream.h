@@ -0,0 +1,82 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_stream.h
+ *
+ * Overview:
+ * Segmented streaming protocol shared by the clients and
+ * the daemons. After the "enc_bs_stream" / "dec_bs_stream"
+ * handshake the client sends segments of the form
+ *
+ *     [4-byte length n][n message bytes][n key bytes]
+ *
+ * and ends with a zero length. The daemon transforms each
+ * segment as soon as it arrives and writes the n result
+ * bytes straight back, so its memory use is fixed no matter
+ * how long the message is. The "_stream_bytes" handshakes
+ * carry binary data the same way.
+ *
+ * Protocol v2 skips the handshake round trip: the client's
+ * first flight is a v2Header followed by the message and
+ * key, and the daemon answers with a v2Header carrying a
+ * status and exactly the result's length, then the result.
+ * With V2_PACKED set, message, key and result all travel
+ * packed (packText), cutting the bytes on the wire by 40%.
+ *
+ * Any of these runs over TCP or, when client and daemon
+ * share a host, over a Unix stream socket: an endpoint with
+ * a '/' in it is a socket path, host:port names a daemon on
+ * another host, and a bare port means this one.
+ ************************************************************/
+
+#ifndef OTP_STREAM_H
+#define OTP_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#define STREAM_SEGMENT 65536    //largest segment either side will send or accept
+
+#define V2_MAGIC "OTP2"
+#define V2_VERSION 2
+#define V2_MAX_LENGTH (1 << 26)    //largest v2 message, bigger ones go by stream
+
+#define V2_ENCRYPT 1    //request codes
+#define V2_DECRYPT 2
+
+#define V2_OK 0         //response codes
+#define V2_INVALID 1    //message or key holds chars outside the alphabet
+#define V2_REFUSED 2    //daemon doesn't do that operation
+#define V2_TOO_LARGE 3  //message over V2_MAX_LENGTH or the connection's budget, or key shorter than message
+#define V2_BUSY 4       //daemon is at its memory cap, try again later
+
+#define V2_BINARY 0x1   //flag: any byte, XOR
+#define V2_PACKED 0x2   //flag: text packed five symbols to three bytes, lengths still count symbols
+
+struct v2Header {
+    char magic[4];         //V2_MAGIC, no NUL
+    uint8_t version;       //V2_VERSION
+    uint8_t code;          //operation in a request, status in a response
+    uint16_t flags;        //big-endian, like the lengths
+    uint32_t length;       //message bytes in a request, result bytes in a response
+    uint32_t keyLength;    //key bytes following the message, 0 in a response
+};
+
+struct cipherAlphabet;
+
+typedef int (*segmentTransform)(char *message, const char *key, size_t length);    //0, or -1 on invalid input
+
+int endpointIsPath(const char *endpoint);
+int endpointAddress(const char *endpoint, struct sockaddr_storage *address, socklen_t *length);
+ssize_t readFull(int fd, void *buffer, size_t length);
+ssize_t writeFull(int fd, const void *buffer, size_t length);
+int writeVector(int fd, struct iovec *iov, int count);
+ssize_t forwardOutput(int sockfd, int outfd, size_t length);
+int segmentVector(struct iovec *iov, const uint32_t *header, const char *message, const char *key,
+                  size_t segment, size_t sent);
+int sendStream(int sockfd, const char *message, const char *key, long length, const struct cipherAlphabet *validate, int outfd);
+
+#endif
@@ -0,0 +1,213 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_timer.c
+ *
+ * Overview:
+ * The timing wheel. Times are CLOCK_MONOTONIC milliseconds
+ * and are rounded up to whole ticks. An entry sits at the
+ * lowest level whose span covers its distance from the
+ * current tick; when the wheel's lower digits roll over to
+ * zero, the matching slot one level up is emptied back
+ * into the wheel, which puts its entries a level lower.
+ ************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include "otp_timer.h"
+
+
+/***********************************************************
+ * timerNow: monotonic clock for deadlines.
+ *
+ * parameters: none.
+ * returns: milliseconds.
+ ***********************************************************/
+
+uint64_t timerNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/***********************************************************
+ * timerInit: empties a wheel and starts it at a time.
+ *
+ * parameters: wheel, current time.
+ * returns: none.
+ ***********************************************************/
+
+void timerInit(struct timerWheel *wheel, uint64_t now) {
+    memset(wheel, '\0', sizeof(*wheel));
+    wheel->tick = now / TIMER_TICK;
+}
+
+
+/***********************************************************
+ * place: links an entry into the slot for its expiry tick.
+ *
+ * parameters: wheel, entry.
+ * returns: none.
+ ***********************************************************/
+
+static void place(struct timerWheel *wheel, struct timerEntry *entry) {
+    uint64_t delta;
+    int level, slot;
+
+    if (entry->expires < wheel->tick)    //overdue, goes out with the next tick
+        entry->expires = wheel->tick;
+    delta = entry->expires - wheel->tick;
+    for (level = 0; level < TIMER_LEVELS - 1 && delta >> (TIMER_BITS * (level + 1)) != 0; level++)
+        ;
+    if (delta >> (TIMER_BITS * TIMER_LEVELS) != 0)    //past the top level, its owner reschedules when it comes up
+        entry->expires = wheel->tick + ((uint64_t) 1 << (TIMER_BITS * TIMER_LEVELS)) - 1;
+    slot = (entry->expires >> (TIMER_BITS * level)) & (TIMER_SLOTS - 1);
+
+    entry->slot = level * TIMER_SLOTS + slot;
+    entry->next = wheel->slots[level][slot];
+    if (entry->next != NULL)
+        entry->next->prev = &entry->next;
+    entry->prev = &wheel->slots[level][slot];
+    wheel->slots[level][slot] = entry;
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+
+/***********************************************************
+ * detach: takes an entry out of its slot.
+ *
+ * parameters: wheel, entry.
+ * returns: none.
+ ***********************************************************/
+
+static void detach(struct timerWheel *wheel, struct timerEntry *entry) {
+    int level = entry->slot / TIMER_SLOTS, slot = entry->slot % TIMER_SLOTS;
+
+    *entry->prev = entry->next;
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    entry->prev = NULL;
+    if (wheel->slots[level][slot] == NULL)
+        wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+}
+
+
+/***********************************************************
+ * timerSchedule: schedules an entry, moving it if it was
+ *                already scheduled.
+ *
+ * parameters: wheel, entry, deadline in milliseconds.
+ * returns: none.
+ ***********************************************************/
+
+void timerSchedule(struct timerWheel *wheel, struct timerEntry *entry, uint64_t when) {
+    if (entry->prev != NULL)
+        detach(wheel, entry);
+    else
+        wheel->count++;
+    entry->expires = (when + TIMER_TICK - 1) / TIMER_TICK;
+    place(wheel, entry);
+}
+
+
+/***********************************************************
+ * timerCancel: unschedules an entry. does nothing if it
+ *              isn't scheduled.
+ *
+ * parameters: wheel, entry.
+ * returns: none.
+ ***********************************************************/
+
+void timerCancel(struct timerWheel *wheel, struct timerEntry *entry) {
+    if (entry->prev != NULL) {
+        detach(wheel, entry);
+        wheel->count--;
+    }
+}
+
+
+/***********************************************************
+ * cascade: empties a slot back into the wheel, which moves
+ *          its entries down a level.
+ *
+ * parameters: wheel, level, slot.
+ * returns: none.
+ ***********************************************************/
+
+static void cascade(struct timerWheel *wheel, int level, int slot) {
+    struct timerEntry *entry = wheel->slots[level][slot], *next;
+
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+    for (; entry != NULL; entry = next) {
+        next = entry->next;
+        place(wheel, entry);
+    }
+}
+
+
+/***********************************************************
+ * timerExpire: moves the wheel up to a time and takes out
+ *              every entry that came due on the way.
+ *
+ * parameters: wheel, current time.
+ * returns: expired entries linked through next, no longer
+ *          scheduled; NULL if none.
+ ***********************************************************/
+
+struct timerEntry *timerExpire(struct timerWheel *wheel, uint64_t now) {
+    struct timerEntry *expired = NULL, *entry;
+    uint64_t target = now / TIMER_TICK;
+    int level, slot;
+
+    if (wheel->count == 0) {    //nothing to pass on the way
+        if (wheel->tick <= target)
+            wheel->tick = target + 1;
+        return NULL;
+    }
+    for (; wheel->tick <= target; wheel->tick++) {
+        for (level = 1; level < TIMER_LEVELS; level++) {    //lower digits rolled over, bring the next slot down
+            if ((wheel->tick & (((uint64_t) 1 << (TIMER_BITS * level)) - 1)) != 0)
+                break;
+            cascade(wheel, level, (wheel->tick >> (TIMER_BITS * level)) & (TIMER_SLOTS - 1));
+        }
+        slot = wheel->tick & (TIMER_SLOTS - 1);
+        while ((entry = wheel->slots[0][slot]) != NULL) {
+            detach(wheel, entry);
+            wheel->count--;
+            entry->next = expired;
+            expired = entry;
+        }
+    }
+    return expired;
+}
+
+
+/***********************************************************
+ * timerTimeout: how long an event loop may sleep before the
+ *               wheel needs to move: until the next entry
+ *               at the bottom level, or until the next
+ *               cascade if there is none there.
+ *
+ * parameters: wheel, current time.
+ * returns: milliseconds, -1 if the wheel is empty.
+ ***********************************************************/
+
+int timerTimeout(const struct timerWheel *wheel, uint64_t now) {
+    int shift = wheel->tick & (TIMER_SLOTS - 1), level;
+    uint64_t bits, due = (wheel->tick + TIMER_SLOTS - 1) & ~(uint64_t) (TIMER_SLOTS - 1);    //next cascade, an upper slot may come down with early entries
+    int upper = 0;
+
+    if (wheel->count == 0)
+        return -1;
+    for (level = 1; level < TIMER_LEVELS; level++)
+        upper |= wheel->occupied[level] != 0;
+    bits = shift == 0 ? wheel->occupied[0] : wheel->occupied[0] >> shift | wheel->occupied[0] << (TIMER_SLOTS - shift);
+    if (bits != 0 && (!upper || wheel->tick + __builtin_ctzll(bits) < due))
+        due = wheel->tick + __builtin_ctzll(bits);
+    if (due * TIMER_TICK <= now)
+        return 0;
+    return due * TIMER_TICK - now;
+}
@@ -0,0 +1,48 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_timer.h
+ *
+ * Overview:
+ * Hierarchical timing wheel for the event-driven server
+ * modes. Each level has 64 slots, each slot of a level
+ * spans one full turn of the level below, and an entry
+ * drops down a level whenever the wheel reaches its slot,
+ * so scheduling, cancelling and expiring are all constant
+ * time however many connections are waiting. Entries are
+ * embedded in whatever they time, and a bitmap of occupied
+ * slots tells the event loop how long it may sleep.
+ ************************************************************/
+
+#ifndef OTP_TIMER_H
+#define OTP_TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_TICK 10                       //milliseconds per tick, deadlines never fire early
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_LEVELS 4                      //64^4 ticks, about 19 days; later deadlines wait at the top
+
+struct timerEntry {
+    struct timerEntry *next;
+    struct timerEntry **prev;               //link pointing at this entry, NULL when not scheduled
+    uint64_t expires;                       //tick
+    int slot;                               //level * TIMER_SLOTS + slot
+};
+
+struct timerWheel {
+    uint64_t tick;                          //next tick to expire
+    long count;                             //entries scheduled
+    uint64_t occupied[TIMER_LEVELS];        //bit per non-empty slot
+    struct timerEntry *slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+uint64_t timerNow(void);
+void timerInit(struct timerWheel *wheel, uint64_t now);
+void timerSchedule(struct timerWheel *wheel, struct timerEntry *entry, uint64_t when);
+void timerCancel(struct timerWheel *wheel, struct timerEntry *entry);
+struct timerEntry *timerExpire(struct timerWheel *wheel, uint64_t now);
+int timerTimeout(const struct timerWheel *wheel, uint64_t now);
+
+#endif
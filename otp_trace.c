@@ -0,0 +1,119 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_trace.c
+ *
+ * Overview:
+ * Writer side of the trace ring. A record is claimed with a
+ * relaxed fetch-add on the ring's head and published by
+ * storing its sequence last, so a reader can tell a finished
+ * record from one being written or overwritten. When the
+ * ring wraps the oldest records are lost, never the newest.
+ ************************************************************/
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "otp_trace.h"
+
+static struct traceRing *ring;         //NULL until traceOpen
+static struct traceRecord *records;
+static uint32_t requests;              //requests numbered so far in this process
+static uint32_t pid;                   //refreshed per request, so forked children get their own
+
+static const char *const phaseNames[TRACE_PHASES] = {"handshake", "receive", "transform", "send", "total", "fork"};
+
+
+/***********************************************************
+ * traceOpen: creates the ring file and maps it. must be
+ *            called before forking so every worker writes
+ *            to the same ring.
+ *
+ * parameters: file path, replaced if it exists.
+ * returns: 0 on success, -1 on error.
+ ***********************************************************/
+
+int traceOpen(const char *path) {
+    size_t size = sizeof(*ring) + (size_t) TRACE_RECORDS * sizeof(*records);
+    void *mapped;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {    //a fresh file reads as zeros, so no record looks written
+        close(fd);
+        return -1;
+    }
+    mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return -1;
+    }
+    ring = mapped;
+    records = (struct traceRecord *) (ring + 1);
+    ring->version = TRACE_VERSION;
+    ring->capacity = TRACE_RECORDS;
+    memcpy(ring->magic, TRACE_MAGIC, sizeof(ring->magic));    //last, a reader checks it first
+    metricsTiming();
+    return 0;
+}
+
+
+/***********************************************************
+ * traceRequest: numbers a new request in this process.
+ *
+ * parameters: none.
+ * returns: request number, 0 when tracing is off.
+ ***********************************************************/
+
+uint32_t traceRequest(void) {
+    if (ring == NULL) {
+        return 0;
+    }
+    pid = getpid();
+    return ++requests;
+}
+
+
+/***********************************************************
+ * traceSpan: appends one phase of a request to the ring.
+ *
+ * parameters: request number, phase, start and end in
+ *             metricsNow nanoseconds, bytes covered.
+ * returns: none.
+ ***********************************************************/
+
+void traceSpan(uint32_t request, int phase, uint64_t start, uint64_t end, uint64_t bytes) {
+    struct traceRecord *record;
+    uint64_t ticket;
+
+    if (ring == NULL) {
+        return;
+    }
+    ticket = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    record = &records[ticket & (TRACE_RECORDS - 1)];
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);    //readers skip it until it's whole again
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->start = start;
+    record->duration = end - start;
+    record->bytes = bytes;
+    record->pid = pid;
+    record->request = request;
+    record->phase = phase;
+    __atomic_store_n(&record->sequence, ticket + 1, __ATOMIC_RELEASE);
+}
+
+
+/***********************************************************
+ * tracePhaseName: names a phase for the reader.
+ *
+ * parameters: phase.
+ * returns: name, "unknown" if out of range.
+ ***********************************************************/
+
+const char *tracePhaseName(int phase) {
+    return phase >= 0 && phase < TRACE_PHASES ? phaseNames[phase] : "unknown";
+}
@@ -0,0 +1,52 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_trace.h
+ *
+ * Overview:
+ * Per-request phase tracing. With -T the daemon maps a ring
+ * of fixed-size records from a file (ideally on /dev/shm)
+ * before forking, and every process appends a record for
+ * each phase of each request it serves: a ticket from one
+ * shared counter picks the slot, so writers never wait on
+ * each other. otp_traceview reads the same file while the
+ * daemon runs. Until traceOpen is called every span is a
+ * no-op.
+ ************************************************************/
+
+#ifndef OTP_TRACE_H
+#define OTP_TRACE_H
+
+#include <stdint.h>
+#include "otp_metrics.h"
+
+#define TRACE_MAGIC "OTPTRACE"
+#define TRACE_VERSION 1
+#define TRACE_RECORDS 65536    //power of two, about 4 MiB of ring
+
+#define TRACE_FORK METRIC_PHASES           //accept returning to the forked child starting; the other phases are metricPhase
+#define TRACE_PHASES (METRIC_PHASES + 1)
+
+struct traceRecord {
+    uint64_t sequence;    //ticket + 1 once written, 0 while being written
+    uint64_t start;       //CLOCK_MONOTONIC nanoseconds
+    uint64_t duration;
+    uint64_t bytes;       //message bytes the phase covered, 0 if not known
+    uint32_t pid;
+    uint32_t request;     //per-process request number
+    uint32_t phase;
+} __attribute__((aligned(64)));    //two writers never share a line
+
+struct traceRing {
+    char magic[8];        //TRACE_MAGIC, no NUL
+    uint32_t version;
+    uint32_t capacity;    //records
+    uint64_t head;        //next ticket
+} __attribute__((aligned(64)));    //records follow
+
+int traceOpen(const char *path);
+uint32_t traceRequest(void);
+void traceSpan(uint32_t request, int phase, uint64_t start, uint64_t end, uint64_t bytes);
+const char *tracePhaseName(int phase);
+
+#endif
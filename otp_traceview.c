@@ -0,0 +1,180 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_traceview.c
+ *
+ * Overview:
+ * Reads the trace ring a daemon started with -T writes to,
+ * live or after the fact. Prints the records as Chrome trace
+ * JSON (load it in chrome://tracing or Perfetto; each
+ * request is its own row under its process) or, with -s, a
+ * per-phase latency summary.
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "otp_trace.h"
+#include "otp_hist.h"
+
+
+/***********************************************************
+ * mapRing: maps a trace file read-only and checks it.
+ *
+ * parameters: file path.
+ * returns: ring, exits on error.
+ ***********************************************************/
+
+static const struct traceRing *mapRing(const char *path) {
+    const struct traceRing *ring;
+    struct stat info;
+    void *mapped;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if ((size_t) info.st_size < sizeof(*ring)) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        exit(1);
+    }
+    mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    ring = mapped;
+    if (memcmp(ring->magic, TRACE_MAGIC, sizeof(ring->magic)) != 0 || ring->version != TRACE_VERSION ||
+        ring->capacity == 0 || (ring->capacity & (ring->capacity - 1)) != 0 ||
+        (size_t) info.st_size < sizeof(*ring) + (size_t) ring->capacity * sizeof(struct traceRecord)) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        exit(1);
+    }
+    return ring;
+}
+
+
+/***********************************************************
+ * readRecord: copies one record out of the ring if it's
+ *             still the one the ticket wrote.
+ *
+ * parameters: ring, ticket, record to fill.
+ * returns: 1 if copied, 0 if it's being written or was
+ *          already overwritten.
+ ***********************************************************/
+
+static int readRecord(const struct traceRing *ring, uint64_t ticket, struct traceRecord *copy) {
+    const struct traceRecord *record = (const struct traceRecord *) (ring + 1) + (ticket & (ring->capacity - 1));
+
+    if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != ticket + 1) {
+        return 0;
+    }
+    memcpy(copy, (const void *) record, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == ticket + 1 && copy->sequence == ticket + 1;    //unchanged while copying
+}
+
+
+/***********************************************************
+ * printChrome: prints the ring as Chrome trace JSON.
+ *
+ * parameters: ring, first ticket, head.
+ * returns: none.
+ ***********************************************************/
+
+static void printChrome(const struct traceRing *ring, uint64_t first, uint64_t head) {
+    struct traceRecord record;
+    uint64_t ticket;
+    long printed = 0;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (ticket = first; ticket < head; ticket++) {
+        if (!readRecord(ring, ticket, &record)) {
+            continue;
+        }
+        printf("%s\n{\"name\":\"%s\",\"cat\":\"otp\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"bytes\":%llu}}",
+               printed > 0 ? "," : "", tracePhaseName(record.phase), record.start / 1e3, record.duration / 1e3,
+               record.pid, record.request, (unsigned long long) record.bytes);    //Chrome wants microseconds
+        printed++;
+    }
+    printf("\n]}\n");
+}
+
+
+/***********************************************************
+ * printSummary: prints count, mean and percentiles for each
+ *               phase.
+ *
+ * parameters: ring, first ticket, head.
+ * returns: none.
+ ***********************************************************/
+
+static void printSummary(const struct traceRing *ring, uint64_t first, uint64_t head) {
+    static struct histogram phases[TRACE_PHASES];
+    struct traceRecord record;
+    uint64_t ticket;
+    int i;
+
+    for (i = 0; i < TRACE_PHASES; i++)
+        histInit(&phases[i]);
+    for (ticket = first; ticket < head; ticket++) {
+        if (readRecord(ring, ticket, &record) && record.phase < TRACE_PHASES) {
+            histRecord(&phases[record.phase], record.duration);
+        }
+    }
+
+    printf("%-10s %10s %12s %12s %12s %12s %12s\n", "phase", "count", "mean_us", "p50_us", "p99_us", "p999_us", "max_us");
+    for (i = 0; i < TRACE_PHASES; i++) {
+        if (phases[i].total == 0) {
+            continue;
+        }
+        printf("%-10s %10llu %12.1f %12.1f %12.1f %12.1f %12.1f\n", tracePhaseName(i), (unsigned long long) phases[i].total,
+               phases[i].sum / phases[i].total / 1e3, histPercentile(&phases[i], 50) / 1e3,
+               histPercentile(&phases[i], 99) / 1e3, histPercentile(&phases[i], 99.9) / 1e3, phases[i].max / 1e3);
+    }
+}
+
+
+/***********************************************************
+ * main: maps the ring and prints what's in it.
+ *
+ * parameters: number of arguments, argument array.
+ * returns: exit status.
+ ***********************************************************/
+
+int main(int argc, char *argv[]) {
+    const struct traceRing *ring;
+    uint64_t head, first;
+    int opt, summary = 0;
+
+    while ((opt = getopt(argc, argv, "s")) != -1) {
+        if (opt == 's') {
+            summary = 1;    //per-phase latencies instead of every record
+        } else {
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: %s [-s] <tracefile>\n", argv[0]);
+        exit(1);
+    }
+
+    ring = mapRing(argv[optind]);
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    first = head > ring->capacity ? head - ring->capacity : 0;    //older tickets were overwritten
+    if (summary)
+        printSummary(ring, first, head);
+    else
+        printChrome(ring, first, head);
+    if (head > ring->capacity)
+        fprintf(stderr, "%s: ring wrapped, %llu older records lost\n", argv[0], (unsigned long long) (head - ring->capacity));
+    return 0;
+}
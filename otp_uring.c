@@ -0,0 +1,643 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_uring.c
+ *
+ * Overview:
+ * io_uring server mode, talking to the kernel through the
+ * raw syscalls so nothing beyond the kernel headers is
+ * needed. Each listening socket has one multishot accept
+ * armed. Every connection gets a slot in an arena of
+ * registered buffers and reads into it with READ_FIXED. The
+ * bytes are fed through the state machine, which transforms
+ * them in place, and the response write goes out linked to
+ * the next read. One io_uring_enter then both submits the
+ * pair and collects whatever finished, and the next request
+ * isn't read until the response is out. Large request
+ * bodies are read straight into the connection's own
+ * buffer instead. Deadlines sit in a timing wheel, and a
+ * read on a timerfd armed for the wheel's next tick wakes
+ * the ring when one may have passed.
+ ************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/io_uring.h>
+#include "otp_metrics.h"
+#include "otp_uring.h"
+
+#define URING_ENTRIES 1024        //submission queue
+#define URING_CQ_ENTRIES 8192     //a read and a write can be in flight for every connection
+#define URING_SLOTS 1024          //registered read buffers, one per connection
+#define URING_SLOT 16384
+#define URING_DIRECT URING_SLOT   //reads at least this big go straight to the connection's buffer
+
+#define OP_READ 0      //low bits of user_data, above them a connection or listener index
+#define OP_WRITE 1
+#define OP_ACCEPT 2
+#define OP_ADMIN 3
+#define OP_CLOSE 4
+#define OP_TIMER 5
+#define OP_MASK 7
+
+struct uring {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned sqEntries, tail;    //tail is ours until the next enter publishes it
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+};
+
+struct uringConn {
+    struct connection conn;
+    char *slot;                 //read buffer
+    int slotIndex;              //in the registered arena, -1 if it ran out and this one is malloc'd
+    size_t slotStart, slotEnd;  //bytes read but not yet fed to the state machine
+    int direct;                 //read in flight goes straight to connInput's target
+    int reading, writing;
+    int failed;
+};
+
+static struct uring ring;
+static char *arena;
+static int fixedBuffers;    //the arena is registered, reads can use READ_FIXED
+static int freeSlots[URING_SLOTS], freeCount;
+static int multishot = 1;   //cleared if the kernel turns down multishot accept
+static struct timerWheel uringTimers;
+static int timerFD;
+static uint64_t timerExpirations;    //read target, the count isn't used
+static uint64_t armedFor;            //when the timerfd goes off, 0 if it isn't armed
+
+
+/***********************************************************
+ * uringSetup: creates the ring and maps its queues.
+ *
+ * parameters: none.
+ * returns: 0 on success, -1 if io_uring is unavailable.
+ ***********************************************************/
+
+static int uringSetup(void) {
+    struct io_uring_params params;
+    size_t sqSize, cqSize;
+    char *sq, *cq;
+
+    memset(&params, '\0', sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;    //completions run only when this thread waits
+    params.cq_entries = URING_CQ_ENTRIES;
+    ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring.fd < 0 && errno == EINVAL) {    //older kernel, plain ring
+        memset(&params, '\0', sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_CQ_ENTRIES;
+        ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+    if (ring.fd < 0) {
+        return -1;
+    }
+
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqSize = cqSize = sqSize > cqSize ? sqSize : cqSize;
+    }
+    sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        return -1;
+    }
+    cq = sq;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            return -1;
+        }
+    }
+    ring.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    ring.sqHead = (unsigned *) (sq + params.sq_off.head);
+    ring.sqTail = (unsigned *) (sq + params.sq_off.tail);
+    ring.sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned *) (sq + params.sq_off.array);
+    ring.sqEntries = params.sq_entries;
+    ring.tail = *ring.sqTail;
+    ring.cqHead = (unsigned *) (cq + params.cq_off.head);
+    ring.cqTail = (unsigned *) (cq + params.cq_off.tail);
+    ring.cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+
+/***********************************************************
+ * uringSupported: checks the kernel has every operation
+ *                 this mode uses.
+ *
+ * parameters: none.
+ * returns: 1 if it does, 0 if not.
+ ***********************************************************/
+
+static int uringSupported(void) {
+    static const int needed[] = {IORING_OP_ACCEPT, IORING_OP_READ_FIXED, IORING_OP_READ, IORING_OP_WRITE,
+                                 IORING_OP_POLL_ADD, IORING_OP_CLOSE};
+    struct io_uring_probe *probe;
+    size_t i;
+    int supported;
+
+    probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return 0;
+    }
+    supported = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (i = 0; supported && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+
+/***********************************************************
+ * uringEnter: publishes queued submissions and optionally
+ *             waits for a completion.
+ *
+ * parameters: completions to wait for.
+ * returns: io_uring_enter result.
+ ***********************************************************/
+
+static int uringEnter(unsigned wait) {
+    unsigned pending;
+
+    __atomic_store_n(ring.sqTail, ring.tail, __ATOMIC_RELEASE);
+    pending = ring.tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+    return syscall(__NR_io_uring_enter, ring.fd, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+
+/***********************************************************
+ * uringReserve: makes room for a number of submissions,
+ *               flushing the queue to the kernel if full.
+ *
+ * parameters: submissions needed together.
+ * returns: none.
+ ***********************************************************/
+
+static void uringReserve(unsigned count) {
+    while (ring.sqEntries - (ring.tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE)) < count) {
+        uringEnter(0);
+    }
+}
+
+
+/***********************************************************
+ * uringSqe: takes the next submission entry, cleared.
+ *
+ * parameters: operation, fd, user data.
+ * returns: entry.
+ ***********************************************************/
+
+static struct io_uring_sqe *uringSqe(int opcode, int fd, uint64_t userData) {
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    uringReserve(1);
+    index = ring.tail & *ring.sqMask;
+    sqe = &ring.sqes[index];
+    memset(sqe, '\0', sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    ring.sqArray[index] = index;
+    ring.tail++;
+    return sqe;
+}
+
+
+/***********************************************************
+ * queueAccept: arms an accept on a listening socket,
+ *              multishot if the kernel allows it.
+ *
+ * parameters: listener index, listening socket.
+ * returns: none.
+ ***********************************************************/
+
+static void queueAccept(int listener, int listenSocketFD) {
+    struct io_uring_sqe *sqe = uringSqe(IORING_OP_ACCEPT, listenSocketFD, ((uint64_t) listener << 3) | OP_ACCEPT);
+
+    if (multishot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;    //one submission, a completion per connection
+    }
+}
+
+
+/***********************************************************
+ * queueAdmin: waits for a metrics scrape.
+ *
+ * parameters: admin socket.
+ * returns: none.
+ ***********************************************************/
+
+static void queueAdmin(int adminSocketFD) {
+    struct io_uring_sqe *sqe = uringSqe(IORING_OP_POLL_ADD, adminSocketFD, OP_ADMIN);
+
+    sqe->poll32_events = POLLIN;
+}
+
+
+/***********************************************************
+ * queueRead: reads into the connection's slot, or for a big
+ *            body straight into the state machine's buffer.
+ *
+ * parameters: connection, direct target (NULL for the
+ *             slot), its length.
+ * returns: none.
+ ***********************************************************/
+
+static void queueRead(struct uringConn *uc, char *target, size_t length) {
+    struct io_uring_sqe *sqe;
+
+    uc->direct = target != NULL;
+    if (uc->direct) {
+        sqe = uringSqe(IORING_OP_READ, uc->conn.fd, (uint64_t) (uintptr_t) uc | OP_READ);
+        sqe->addr = (uintptr_t) target;
+        sqe->len = length;
+    } else {
+        uc->slotStart = uc->slotEnd = 0;
+        sqe = uringSqe(fixedBuffers && uc->slotIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ, uc->conn.fd,
+                       (uint64_t) (uintptr_t) uc | OP_READ);
+        sqe->addr = (uintptr_t) uc->slot;
+        sqe->len = URING_SLOT;
+        sqe->buf_index = 0;    //the whole arena is one registered buffer
+    }
+    uc->reading = 1;
+}
+
+
+/***********************************************************
+ * queueWrite: sends pending output. unless the connection
+ *             is closing, the next read is linked behind it,
+ *             so it starts as soon as the response is out
+ *             without another trip through this loop.
+ *
+ * parameters: connection, data, length.
+ * returns: none.
+ ***********************************************************/
+
+static void queueWrite(struct uringConn *uc, const char *data, size_t length) {
+    struct io_uring_sqe *sqe;
+    int link = uc->conn.state != CONN_CLOSING && uc->slotStart == uc->slotEnd;
+
+    uringReserve(2);    //a link can't be split across two submissions
+    sqe = uringSqe(IORING_OP_WRITE, uc->conn.fd, (uint64_t) (uintptr_t) uc | OP_WRITE);
+    sqe->addr = (uintptr_t) data;
+    sqe->len = length;
+    uc->writing = 1;
+    if (link) {
+        sqe->flags |= IOSQE_IO_LINK;    //a short write cancels the read, and it is queued again after
+        queueRead(uc, NULL, 0);
+    }
+}
+
+
+/***********************************************************
+ * closeUringConn: closes a connection through the ring and
+ *                 frees it.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void closeUringConn(struct uringConn *uc) {
+    timerCancel(&uringTimers, &uc->conn.timer);
+    uringSqe(IORING_OP_CLOSE, uc->conn.fd, OP_CLOSE);
+    connFree(&uc->conn);
+    if (uc->slotIndex >= 0) {
+        freeSlots[freeCount++] = uc->slotIndex;
+    } else {
+        free(uc->slot);
+    }
+    free(uc);
+}
+
+
+/***********************************************************
+ * advance: feeds buffered input to the state machine and
+ *          queues whatever I/O it needs next. closes the
+ *          connection once it is done or has failed and
+ *          nothing is in flight.
+ *
+ * parameters: connection.
+ * returns: none.
+ ***********************************************************/
+
+static void advance(struct uringConn *uc) {
+    struct connection *conn = &uc->conn;
+    const char *data;
+    char *target;
+    size_t length, want;
+
+    while (!uc->failed && !uc->reading && !uc->writing) {
+        length = connOutput(conn, &data);
+        if (length > 0) {    //always flush before reading more
+            queueWrite(uc, data, length);
+            break;
+        }
+        if (connDone(conn)) {
+            break;
+        }
+        want = connInput(conn, &target);
+        if (want == 0) {
+            errno = EPROTO;
+            uc->failed = 1;
+            break;
+        }
+        if (uc->slotStart < uc->slotEnd) {    //bytes already here
+            length = uc->slotEnd - uc->slotStart < want ? uc->slotEnd - uc->slotStart : want;
+            memcpy(target, uc->slot + uc->slotStart, length);
+            uc->slotStart += length;
+            if (connReceived(conn, length) < 0) {
+                uc->failed = 1;
+            }
+            continue;
+        }
+        queueRead(uc, want >= URING_DIRECT ? target : NULL, want);
+    }
+    if ((uc->failed || connDone(conn)) && !uc->reading && !uc->writing) {
+        closeUringConn(uc);
+    }
+}
+
+
+/***********************************************************
+ * acceptConn: sets up a newly accepted connection.
+ *
+ * parameters: socket, server config.
+ * returns: none.
+ ***********************************************************/
+
+static void acceptConn(int fd, const struct serverConfig *config) {
+    struct uringConn *uc = calloc(1, sizeof(*uc));
+
+    if (uc == NULL) {
+        close(fd);
+        return;
+    }
+    uc->slotIndex = freeCount > 0 ? freeSlots[--freeCount] : -1;
+    uc->slot = uc->slotIndex >= 0 ? arena + (size_t) uc->slotIndex * URING_SLOT : malloc(URING_SLOT);
+    if (uc->slot == NULL) {
+        close(fd);
+        free(uc);
+        return;
+    }
+    connInit(&uc->conn, fd, config);
+    if (connDeadline(&uc->conn) != 0) {
+        timerSchedule(&uringTimers, &uc->conn.timer, connDeadline(&uc->conn));
+    }
+    advance(uc);
+}
+
+
+/***********************************************************
+ * queueTimer: waits for the timerfd to go off.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void queueTimer(void) {
+    struct io_uring_sqe *sqe = uringSqe(IORING_OP_READ, timerFD, OP_TIMER);
+
+    sqe->addr = (uintptr_t) &timerExpirations;
+    sqe->len = sizeof(timerExpirations);
+}
+
+
+/***********************************************************
+ * armTimer: sets the timerfd for the wheel's next tick,
+ *           unless it already goes off by then.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void armTimer(void) {
+    struct itimerspec spec;
+    uint64_t now = timerNow(), due;
+    int timeout = timerTimeout(&uringTimers, now);
+
+    if (timeout < 0) {
+        return;
+    }
+    due = now + timeout;
+    if (armedFor != 0 && armedFor <= due) {
+        return;
+    }
+    memset(&spec, '\0', sizeof(spec));
+    spec.it_value.tv_sec = due / 1000;
+    spec.it_value.tv_nsec = due % 1000 * 1000000;
+    if (timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {    //same clock as timerNow
+        armedFor = due;
+    }
+}
+
+
+/***********************************************************
+ * expireConnections: fails connections whose deadline has
+ *                    passed. one with I/O in flight is shut
+ *                    down, which finishes the I/O, and is
+ *                    closed once it has.
+ *
+ * parameters: none.
+ * returns: none.
+ ***********************************************************/
+
+static void expireConnections(void) {
+    struct timerEntry *entry, *next;
+    struct uringConn *uc;
+    uint64_t now = timerNow(), deadline;
+
+    for (entry = timerExpire(&uringTimers, now); entry != NULL; entry = next) {
+        next = entry->next;
+        uc = (struct uringConn *) ((char *) entry - offsetof(struct uringConn, conn.timer));
+        deadline = connDeadline(&uc->conn);
+        if (deadline > now) {    //it made progress since, check again later
+            timerSchedule(&uringTimers, entry, deadline);
+            continue;
+        }
+        metricsAdd(METRIC_TIMED_OUT, 1);
+        uc->failed = 1;
+        if (uc->reading || uc->writing) {
+            shutdown(uc->conn.fd, SHUT_RDWR);
+        }
+        advance(uc);
+    }
+}
+
+
+/***********************************************************
+ * complete: handles one completion.
+ *
+ * parameters: completion, listening sockets, admin socket,
+ *             server config.
+ * returns: none.
+ ***********************************************************/
+
+static void complete(const struct io_uring_cqe *cqe, const int *listenFDs, int adminSocketFD, const struct serverConfig *config) {
+    struct uringConn *uc = (struct uringConn *) (uintptr_t) (cqe->user_data & ~(uint64_t) OP_MASK);
+    int listener = cqe->user_data >> 3;
+
+    switch (cqe->user_data & OP_MASK) {
+    case OP_ACCEPT:
+        if (cqe->res >= 0) {
+            acceptConn(cqe->res, config);
+        } else if (cqe->res == -EINVAL && multishot) {    //multishot accept came in with 5.19
+            multishot = 0;
+        } else if (cqe->res != -ECONNABORTED && cqe->res != -EINTR) {
+            fprintf(stderr, "%s: ERROR on accept: %s\n", config->name, strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {    //the accept is no longer armed
+            queueAccept(listener, listenFDs[listener]);
+        }
+        break;
+
+    case OP_ADMIN:
+        metricsServe(adminSocketFD);
+        queueAdmin(adminSocketFD);
+        break;
+
+    case OP_TIMER:
+        armedFor = 0;    //the loop expires connections and arms it again
+        queueTimer();
+        break;
+
+    case OP_READ:
+        uc->reading = 0;
+        if (cqe->res == -ECANCELED) {
+            //linked behind a short write, advance queues it again
+        } else if (cqe->res < 0) {
+            errno = -cqe->res;
+            uc->failed = 1;
+        } else if (cqe->res == 0) {    //client hung up
+            if (connHangup(&uc->conn) < 0) {
+                uc->failed = 1;
+            }
+        } else {
+            metricsAdd(METRIC_BYTES_IN, cqe->res);
+            if (uc->direct) {
+                if (connReceived(&uc->conn, cqe->res) < 0) {
+                    uc->failed = 1;
+                }
+            } else {
+                uc->slotEnd = cqe->res;
+            }
+        }
+        advance(uc);
+        break;
+
+    case OP_WRITE:
+        uc->writing = 0;
+        if (cqe->res < 0) {
+            errno = -cqe->res;
+            uc->failed = 1;
+        } else {
+            connSent(&uc->conn, cqe->res);
+            metricsAdd(METRIC_BYTES_OUT, cqe->res);
+        }
+        if (!uc->reading) {    //otherwise wait for the linked read, done or cancelled
+            advance(uc);
+        }
+        break;
+
+    default:    //closes, nothing to do
+        break;
+    }
+}
+
+
+/***********************************************************
+ * serveUring: serves every connection from one thread
+ *             through io_uring.
+ *
+ * parameters: listening sockets, how many, admin socket (-1
+ *             for none), server config.
+ * returns: -1 if io_uring can't be used here, otherwise
+ *          never.
+ ***********************************************************/
+
+int serveUring(const int *listenFDs, int listenCount, int adminSocketFD, const struct serverConfig *config) {
+    struct iovec registered;
+    struct io_uring_cqe cqe;
+    unsigned head, tail;
+    int i;
+
+    if (uringSetup() < 0) {
+        return -1;
+    }
+    if (!uringSupported()) {
+        close(ring.fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFD < 0) {
+        close(ring.fd);
+        return -1;
+    }
+    arena = mmap(NULL, (size_t) URING_SLOTS * URING_SLOT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        close(timerFD);
+        close(ring.fd);
+        return -1;
+    }
+    registered.iov_base = arena;
+    registered.iov_len = (size_t) URING_SLOTS * URING_SLOT;
+    fixedBuffers = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, &registered, 1) == 0;    //pinned, so no per-read page lookups
+    if (!fixedBuffers) {
+        fprintf(stderr, "%s: registering buffers failed (%s), reading without them\n", config->name, strerror(errno));
+    }
+    for (i = URING_SLOTS - 1; i >= 0; i--) {
+        freeSlots[freeCount++] = i;
+    }
+
+    for (i = 0; i < listenCount; i++) {
+        queueAccept(i, listenFDs[i]);
+    }
+    if (adminSocketFD >= 0) {
+        queueAdmin(adminSocketFD);
+    }
+    timerInit(&uringTimers, timerNow());
+    queueTimer();
+    metricsWorkers(1);    //this thread is the only worker
+
+    while (1) {
+        if (uringEnter(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            fprintf(stderr, "%s: ERROR waiting for completions: %s\n", config->name, strerror(errno));
+            exit(1);
+        }
+        head = *ring.cqHead;
+        tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            cqe = ring.cqes[head & *ring.cqMask];
+            head++;
+            __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);    //hand the entry back before handling it
+            complete(&cqe, listenFDs, adminSocketFD, config);
+        }
+        expireConnections();
+        armTimer();
+    }
+}
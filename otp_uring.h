@@ -0,0 +1,19 @@
+/***********************************************************
+ * Author:          Kelsey Helms
+ * Date Created:    October 18, 2026
+ * Filename:        otp_uring.h
+ *
+ * Overview:
+ * io_uring server mode. One thread drives every connection
+ * through the same state machine as the other modes, with
+ * accepts, reads and writes all going through one ring.
+ ************************************************************/
+
+#ifndef OTP_URING_H
+#define OTP_URING_H
+
+#include "otp_server.h"
+
+int serveUring(const int *listenFDs, int listenCount, int adminSocketFD, const struct serverConfig *config);
+
+#endif